@@ -0,0 +1,7 @@
+
+find_path(LIBURING_INCLUDE_DIR NAMES liburing.h)
+find_library(LIBURING_LIBRARY NAMES uring)
+
+include(FindPackageHandleStandardArgs)
+find_package_handle_standard_args(LibUring
+  DEFAULT_MSG LIBURING_LIBRARY LIBURING_INCLUDE_DIR)
@@ -59,6 +59,12 @@ struct IpConfig {
     IpType type = IpType::SLAVE;
     IpImplementation implementation = IpImplementation::SOFTWARE;
 
+    /**
+     * Transactions the IP can have in flight; 0 lets the router decide. A slave is granted that many reads and as
+     * many writes, like the separate read and write acceptance of an AXI slave.
+     */
+    uint32_t maxOutstanding = 0;
+
     void print(std::ostream &o);
 };
 
@@ -96,6 +102,11 @@ private:
  */
 enum class TransactionType { READ_REQ, WRITE_REQ, READ_RESP, WRITE_RESP };
 
+/**
+ * AXI burst types, in the order of the AxBURST encoding
+ */
+enum class BurstType { FIXED, INCR, WRAP };
+
 /**
  * Transaction
  */
@@ -106,9 +117,31 @@ struct Transaction {
     uint64_t id = 0;  //!< The ID of the transaction; set by the initiator, echoed by all processors
     uint64_t address = 0;  //!< Target address
     uint64_t size = 0;  //!< Size of the requestd data
+    uint8_t qos = 0;  //!< AxQOS of the request, from 0 to 15; higher values are more important
+    uint16_t burstLength = 0;  //!< Number of beats, AxLEN + 1; 0 if the transaction is not shaped as an AXI burst
+    uint8_t burstSize = 0;  //!< Bytes per beat as a power of two, AxSIZE
+    BurstType burst = BurstType::INCR;  //!< AxBURST
+    uint32_t axiId = 0;  //!< AxID; echoed in the response
     std::vector<uint8_t> data;  //!< Data buffer
+    std::vector<uint8_t> strobe;  //!< WSTRB, one bit per byte of the data, LSB first; empty if all are written
+    bool posted = false;  //!< A write request only answered if it fails, or the answer to such a request
+    const uint8_t *external = nullptr;  //!< Payload of `size` bytes owned by the caller; used instead of data if set
     bool ok;  //!< Status of a response
     std::string message;  //!< An error message if a response is not OK
 };
 
+/**
+ * A chunk of a piece of AXI4-Stream data on its way to the router
+ */
+struct StreamChunk {
+    uint64_t initiator = 0;  //!< The stream master
+    uint64_t address = 0;  //!< Address of the stream slave, standing for TDEST
+    const uint8_t *data = nullptr;  //!< Payload owned by the caller
+    uint64_t size = 0;  //!< Size of the payload in bytes
+    const uint8_t *keep = nullptr;  //!< TKEEP, one bit per byte of the payload, LSB first; null if all are kept
+    uint64_t user = 0;  //!< TUSER
+    bool last = false;  //!< TLAST; only ever set on the final chunk of a piece
+    bool more = false;  //!< Whether more chunks of the same piece follow
+};
+
 }  // namespace sw_axi
@@ -0,0 +1,171 @@
+//------------------------------------------------------------------------------
+// Copyright (C) 2020 Daedalean AG
+//
+// This file is part of SW-AXI.
+//
+// SW-AXI is free software: you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+//
+// SW-AXI is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with SW-AXI.  If not, see <https://www.gnu.org/licenses/>.
+//------------------------------------------------------------------------------
+
+#include "Encoding.hh"
+
+#include <cstring>
+
+#ifdef __SSE2__
+#include <emmintrin.h>
+#endif
+
+namespace sw_axi {
+
+namespace {
+const size_t BLOCK_SIZE = 16;
+const uint8_t LITERAL = 0x00;
+const uint8_t ZEROS = 0x01;
+const uint8_t REPEAT = 0x02;
+
+/**
+ * Check whether the 16-byte block consists of the given word repeated
+ */
+bool isSplat(const uint8_t *block, uint32_t word) {
+#ifdef __SSE2__
+    __m128i v = _mm_loadu_si128(reinterpret_cast<const __m128i *>(block));
+    return _mm_movemask_epi8(_mm_cmpeq_epi8(v, _mm_set1_epi32(int(word)))) == 0xffff;
+#else
+    uint64_t splat = word | (uint64_t(word) << 32);
+    uint64_t lo, hi;
+    memcpy(&lo, block, sizeof(lo));
+    memcpy(&hi, block + sizeof(lo), sizeof(hi));
+    return lo == splat && hi == splat;
+#endif
+}
+
+void putVarint(std::vector<uint8_t> &out, uint64_t value) {
+    while (value >= 0x80) {
+        out.push_back(uint8_t(value) | 0x80);
+        value >>= 7;
+    }
+    out.push_back(uint8_t(value));
+}
+
+bool getVarint(const uint8_t *&ptr, const uint8_t *end, uint64_t &value) {
+    value = 0;
+    for (unsigned shift = 0; ptr < end && shift < 64; shift += 7) {
+        uint8_t byte = *ptr++;
+        value |= uint64_t(byte & 0x7f) << shift;
+        if (!(byte & 0x80)) {
+            return true;
+        }
+    }
+    return false;
+}
+}  // namespace
+
+size_t encodeRle(const uint8_t *data, size_t size, std::vector<uint8_t> &out) {
+    out.clear();
+    size_t literal = 0;  // Beginning of the literal bytes that have not been emitted yet
+    size_t pos = 0;
+
+    auto emitLiteral = [&](size_t upTo) {
+        if (upTo > literal) {
+            out.push_back(LITERAL);
+            putVarint(out, upTo - literal);
+            out.insert(out.end(), data + literal, data + upTo);
+        }
+    };
+
+    while (pos + BLOCK_SIZE <= size) {
+        uint32_t word;
+        memcpy(&word, data + pos, sizeof(word));
+        if (!isSplat(data + pos, word)) {
+            pos += BLOCK_SIZE;
+            continue;
+        }
+
+        size_t runEnd = pos + BLOCK_SIZE;
+        while (runEnd + BLOCK_SIZE <= size && isSplat(data + runEnd, word)) {
+            runEnd += BLOCK_SIZE;
+        }
+        while (runEnd + sizeof(word) <= size && !memcmp(data + runEnd, &word, sizeof(word))) {
+            runEnd += sizeof(word);
+        }
+
+        emitLiteral(pos);
+        if (!word) {
+            out.push_back(ZEROS);
+            putVarint(out, runEnd - pos);
+        } else {
+            out.push_back(REPEAT);
+            putVarint(out, (runEnd - pos) / sizeof(word));
+            const uint8_t *wordPtr = reinterpret_cast<const uint8_t *>(&word);
+            out.insert(out.end(), wordPtr, wordPtr + sizeof(word));
+        }
+        pos = literal = runEnd;
+
+        if (out.size() >= size) {
+            return 0;
+        }
+    }
+
+    emitLiteral(size);
+    return out.size() < size ? out.size() : 0;
+}
+
+int decodeRle(const uint8_t *data, size_t size, uint8_t *out, size_t outSize) {
+    const uint8_t *ptr = data;
+    const uint8_t *end = data + size;
+    size_t pos = 0;
+
+    while (ptr < end) {
+        uint8_t tag = *ptr++;
+        uint64_t length;
+        if (!getVarint(ptr, end, length)) {
+            return -1;
+        }
+
+        switch (tag) {
+        case LITERAL:
+            if (length > size_t(end - ptr) || length > outSize - pos) {
+                return -1;
+            }
+            memcpy(out + pos, ptr, length);
+            ptr += length;
+            pos += length;
+            break;
+        case ZEROS:
+            if (length > outSize - pos) {
+                return -1;
+            }
+            memset(out + pos, 0, length);
+            pos += length;
+            break;
+        case REPEAT: {
+            uint32_t word;
+            if (size_t(end - ptr) < sizeof(word) || length > (outSize - pos) / sizeof(word)) {
+                return -1;
+            }
+            memcpy(&word, ptr, sizeof(word));
+            ptr += sizeof(word);
+            for (uint64_t i = 0; i < length; ++i, pos += sizeof(word)) {
+                memcpy(out + pos, &word, sizeof(word));
+            }
+            break;
+        }
+        default:
+            return -1;
+        }
+    }
+
+    return pos == outSize ? 0 : -1;
+}
+
+}  // namespace sw_axi
@@ -0,0 +1,51 @@
+//------------------------------------------------------------------------------
+// Copyright (C) 2020 Daedalean AG
+//
+// This file is part of SW-AXI.
+//
+// SW-AXI is free software: you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+//
+// SW-AXI is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with SW-AXI.  If not, see <https://www.gnu.org/licenses/>.
+//------------------------------------------------------------------------------
+
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+
+namespace sw_axi {
+
+/**
+ * Run-length encode a payload.
+ *
+ * The encoded payload is a sequence of records, each made of a tag byte and a LEB128 length:
+ *
+ *   0x00 LITERAL - length raw bytes follow
+ *   0x01 ZEROS   - length zero bytes
+ *   0x02 REPEAT  - a 4-byte word follows; it is repeated length times
+ *
+ * Runs are looked for in 16-byte blocks, so short runs and runs that do not start at a block boundary relative to
+ * the end of the previous run stay in the literals.
+ *
+ * @return the size of the encoded payload; 0 if the encoding does not make the payload smaller
+ */
+size_t encodeRle(const uint8_t *data, size_t size, std::vector<uint8_t> &out);
+
+/**
+ * Decode a run-length encoded payload into a buffer that has exactly the size of the decoded payload
+ *
+ * @return 0 on success; -1 if the encoded payload is malformed or does not decode to outSize bytes
+ */
+int decodeRle(const uint8_t *data, size_t size, uint8_t *out, size_t outSize);
+
+}  // namespace sw_axi
@@ -0,0 +1,128 @@
+//------------------------------------------------------------------------------
+// Copyright (C) 2020 Daedalean AG
+//
+// This file is part of SW-AXI.
+//
+// SW-AXI is free software: you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+//
+// SW-AXI is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with SW-AXI.  If not, see <https://www.gnu.org/licenses/>.
+//------------------------------------------------------------------------------
+
+#include "Placement.hh"
+
+#include <cerrno>
+#include <cstdint>
+#include <cstring>
+#include <linux/mempolicy.h>
+#include <sched.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+
+namespace sw_axi {
+
+namespace {
+/**
+ * Parse a CPU number at the given position and move past it
+ *
+ * @return true on success; false if there is no number
+ */
+bool parseCpu(const std::string &list, size_t &pos, unsigned &cpu) {
+    size_t start = pos;
+    unsigned long value = 0;
+    while (pos < list.size() && list[pos] >= '0' && list[pos] <= '9' && value < CPU_SETSIZE) {
+        value = value * 10 + (list[pos] - '0');
+        ++pos;
+    }
+    cpu = value;
+    return pos != start;
+}
+}  // namespace
+
+Status parseCpuList(const std::string &list, std::vector<unsigned> &cpus) {
+    cpus.clear();
+    size_t pos = 0;
+    while (pos < list.size()) {
+        unsigned first = 0;
+        unsigned last = 0;
+        if (!parseCpu(list, pos, first)) {
+            return Status(1, "Malformed CPU list: " + list);
+        }
+        last = first;
+        if (pos < list.size() && list[pos] == '-') {
+            ++pos;
+            if (!parseCpu(list, pos, last)) {
+                return Status(1, "Malformed CPU list: " + list);
+            }
+        }
+        if (pos < list.size() && list[pos++] != ',') {
+            return Status(1, "Malformed CPU list: " + list);
+        }
+        if (first > last || last >= CPU_SETSIZE) {
+            return Status(1, "Invalid CPU range in the list: " + list);
+        }
+        for (unsigned cpu = first; cpu <= last; ++cpu) {
+            cpus.push_back(cpu);
+        }
+    }
+    return Status();
+}
+
+Status placeThread(pthread_t thread, const ThreadPlacement &placement) {
+    if (!placement.cpus.empty()) {
+        cpu_set_t set;
+        CPU_ZERO(&set);
+        for (unsigned cpu : placement.cpus) {
+            if (cpu >= CPU_SETSIZE) {
+                return Status(1, "CPU number out of range: " + std::to_string(cpu));
+            }
+            CPU_SET(cpu, &set);
+        }
+        int ret = pthread_setaffinity_np(thread, sizeof(set), &set);
+        if (ret) {
+            return Status(1, std::string("Unable to set the CPU affinity of a thread: ") + strerror(ret));
+        }
+    }
+
+    if (placement.fifoPriority) {
+        sched_param param;
+        memset(&param, 0, sizeof(param));
+        param.sched_priority = placement.fifoPriority;
+        int ret = pthread_setschedparam(thread, SCHED_FIFO, &param);
+        if (ret) {
+            return Status(1, std::string("Unable to make a thread use the SCHED_FIFO policy: ") + strerror(ret));
+        }
+    }
+    return Status();
+}
+
+void moveToLocalNode(const void *addr, size_t size) {
+    unsigned cpu = 0;
+    unsigned node = 0;
+    if (!addr || !size || syscall(SYS_getcpu, &cpu, &node, nullptr) == -1) {
+        return;
+    }
+
+    uintptr_t pageSize = sysconf(_SC_PAGESIZE);
+    uintptr_t begin = reinterpret_cast<uintptr_t>(addr) & ~(pageSize - 1);
+    uintptr_t end = reinterpret_cast<uintptr_t>(addr) + size;
+    size_t numPages = (end - begin + pageSize - 1) / pageSize;
+
+    std::vector<void *> pages(numPages);
+    std::vector<int> nodes(numPages, node);
+    std::vector<int> status(numPages);
+    for (size_t i = 0; i < numPages; ++i) {
+        pages[i] = reinterpret_cast<void *>(begin + i * pageSize);
+    }
+    syscall(SYS_move_pages, 0, numPages, pages.data(), nodes.data(), status.data(), MPOL_MF_MOVE);
+}
+
+}  // namespace sw_axi
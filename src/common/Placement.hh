@@ -0,0 +1,62 @@
+//------------------------------------------------------------------------------
+// Copyright (C) 2020 Daedalean AG
+//
+// This file is part of SW-AXI.
+//
+// SW-AXI is free software: you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+//
+// SW-AXI is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with SW-AXI.  If not, see <https://www.gnu.org/licenses/>.
+//------------------------------------------------------------------------------
+
+#pragma once
+
+#include "Data.hh"
+
+#include <cstddef>
+#include <pthread.h>
+#include <string>
+#include <vector>
+
+namespace sw_axi {
+
+/**
+ * Where and how a thread runs
+ */
+struct ThreadPlacement {
+    std::vector<unsigned> cpus;  //!< CPUs the thread may run on; empty lets it run anywhere
+
+    /**
+     * Real-time priority of the thread under the SCHED_FIFO policy, from 1 to 99; 0 keeps the default time-sharing
+     * policy. A busy-polling thread with a real-time priority starves everything else on its CPUs, so it should
+     * have them to itself.
+     */
+    int fifoPriority = 0;
+};
+
+/**
+ * Parse a list of CPUs in the format used by `taskset -c` and the kernel, e.g. `0-3,8,10-11`
+ */
+Status parseCpuList(const std::string &list, std::vector<unsigned> &cpus);
+
+/**
+ * Apply the CPU affinity and the scheduling policy to the thread
+ */
+Status placeThread(pthread_t thread, const ThreadPlacement &placement);
+
+/**
+ * Move the pages of the memory area to the NUMA node of the CPU the calling thread runs on; the pages that are
+ * partially covered by the area move as well. It is a hint that only makes sense for memory that the calling thread
+ * uses the most, once it has been pinned to a node; failures are not reported.
+ */
+void moveToLocalNode(const void *addr, size_t size);
+
+}  // namespace sw_axi
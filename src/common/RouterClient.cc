@@ -18,6 +18,7 @@
 //------------------------------------------------------------------------------
 
 #include "RouterClient.hh"
+#include "Encoding.hh"
 #include "IpcStructs_generated.h"
 #include "Utils.hh"
 
@@ -35,37 +36,205 @@
 
 namespace sw_axi {
 
+namespace {
+const uint32_t SUPPORTED_ENCODINGS = 1u << wire::PayloadEncoding_RLE;
+
+const wire::Transaction *asWire(const void *txn) {
+    return static_cast<const wire::Transaction *>(txn);
+}
+
+/**
+ * Builder for the control messages; shared by all the clients living on the same thread so that its memory is
+ * allocated only once
+ */
+flatbuffers::FlatBufferBuilder &controlBuilder() {
+    static thread_local flatbuffers::FlatBufferBuilder builder(1024);
+    builder.Clear();
+    return builder;
+}
+}  // namespace
+
+uint64_t TransactionView::getInitiator() const {
+    return asWire(txn)->initiator();
+}
+
+uint64_t TransactionView::getTarget() const {
+    return asWire(txn)->target();
+}
+
+uint64_t TransactionView::getId() const {
+    return asWire(txn)->id();
+}
+
+uint64_t TransactionView::getAddress() const {
+    return asWire(txn)->address();
+}
+
+uint64_t TransactionView::getSize() const {
+    return asWire(txn)->size();
+}
+
+uint8_t TransactionView::getQos() const {
+    return asWire(txn)->qos();
+}
+
+uint16_t TransactionView::getBurstLength() const {
+    return asWire(txn)->burstLength();
+}
+
+uint8_t TransactionView::getBurstSize() const {
+    return asWire(txn)->burstSize();
+}
+
+BurstType TransactionView::getBurst() const {
+    return static_cast<BurstType>(asWire(txn)->burst());
+}
+
+uint32_t TransactionView::getAxiId() const {
+    return asWire(txn)->axiId();
+}
+
+bool TransactionView::isPosted() const {
+    return asWire(txn)->posted();
+}
+
+bool TransactionView::isOk() const {
+    return asWire(txn)->ok();
+}
+
+std::string TransactionView::getMessage() const {
+    return asWire(txn)->message() ? asWire(txn)->message()->str() : std::string();
+}
+
+const uint8_t *TransactionView::getData() const {
+    if (payload) {
+        return payload;
+    }
+    return asWire(txn)->data() ? asWire(txn)->data()->Data() : nullptr;
+}
+
+size_t TransactionView::getDataSize() const {
+    if (payload) {
+        return payloadSize;
+    }
+    return asWire(txn)->data() ? asWire(txn)->data()->size() : 0;
+}
+
+const uint8_t *TransactionView::getStrobe() const {
+    return asWire(txn)->strobe() ? asWire(txn)->strobe()->Data() : nullptr;
+}
+
+size_t TransactionView::getStrobeSize() const {
+    return asWire(txn)->strobe() ? asWire(txn)->strobe()->size() : 0;
+}
+
+void TransactionView::copyTo(Transaction &txn) const {
+    txn.type = type;
+    txn.initiator = getInitiator();
+    txn.target = getTarget();
+    txn.id = getId();
+    txn.address = getAddress();
+    txn.size = getSize();
+    txn.qos = getQos();
+    txn.burstLength = getBurstLength();
+    txn.burstSize = getBurstSize();
+    txn.burst = getBurst();
+    txn.axiId = getAxiId();
+    txn.posted = isPosted();
+    txn.data.assign(getData(), getData() + getDataSize());
+    if (getStrobe()) {
+        txn.strobe.assign(getStrobe(), getStrobe() + getStrobeSize());
+    } else {
+        txn.strobe.clear();
+    }
+    txn.ok = isOk();
+    txn.message = getMessage();
+}
+
+bool StreamView::isCredit() const {
+    return msg->type() == wire::Type_STREAM_CREDIT;
+}
+
+uint64_t StreamView::getInitiator() const {
+    return isCredit() ? msg->ipId() : msg->chunk()->initiator();
+}
+
+uint64_t StreamView::getTarget() const {
+    return isCredit() ? 0 : msg->chunk()->target();
+}
+
+uint64_t StreamView::getAddress() const {
+    return isCredit() ? 0 : msg->chunk()->address();
+}
+
+const uint8_t *StreamView::getData() const {
+    return !isCredit() && msg->chunk()->data() ? msg->chunk()->data()->Data() : nullptr;
+}
+
+size_t StreamView::getDataSize() const {
+    return !isCredit() && msg->chunk()->data() ? msg->chunk()->data()->size() : 0;
+}
+
+const uint8_t *StreamView::getKeep() const {
+    return !isCredit() && msg->chunk()->keep() ? msg->chunk()->keep()->Data() : nullptr;
+}
+
+uint64_t StreamView::getUser() const {
+    return isCredit() ? 0 : msg->chunk()->user();
+}
+
+bool StreamView::isLast() const {
+    return !isCredit() && msg->chunk()->last();
+}
+
+bool StreamView::hasMore() const {
+    return !isCredit() && msg->chunk()->more();
+}
+
+uint32_t StreamView::getCredits() const {
+    return isCredit() ? msg->credits() : 0;
+}
+
+RouterClient::~RouterClient() {
+    disconnect();
+}
+
 std::pair<SystemInfo *, Status> RouterClient::connect(const std::string &uri, const std::string &name) {
     if (state != State::DISCONNECTED) {
         Status st = Status(1, "The bridge needs to be disconnected for the connect operation to proceed");
         return std::make_pair(nullptr, st);
     }
 
-    if (uri.length() < 8 || uri.find("unix://") != 0) {
-        Status st = Status(1, "Can only communicate over UNIX domain sockets:" + uri);
+    std::string path;
+    bool useShm = false;
+    if (uri.find("unix://") == 0) {
+        path = uri.substr(7);
+    } else if (uri.find("shm://") == 0) {
+        path = uri.substr(6);
+        useShm = true;
+    }
+
+    if (path.empty()) {
+        Status st = Status(1, "Can only communicate over UNIX domain sockets or shared memory:" + uri);
         return std::make_pair(nullptr, st);
     }
-    std::string path = uri.substr(7);
 
-    sockaddr_un addr;
-    if (path.length() > sizeof(addr.sun_path) - 1) {
-        std::make_pair(nullptr, Status(1, "Path too long: " + path));
+    if (useShm && (stripes > 1 || splitChannels)) {
+        return std::make_pair(nullptr, Status(1, "Only the unix:// transport can use multiple connections"));
     }
 
-    sock = socket(AF_UNIX, SOCK_STREAM, 0);
-    if (sock == -1) {
-        Status st = Status(1, std::string("Unable to create a UNIX socket: ") + strerror(errno));
+    Status st = openSocket(path);
+    if (st.isError()) {
         return std::make_pair(nullptr, st);
     }
 
-    memset(&addr, 0, sizeof(sockaddr_un));
-    addr.sun_family = AF_UNIX;
-    strncpy(addr.sun_path, path.c_str(), sizeof(addr.sun_path) - 1);
-
-    if (::connect(sock, reinterpret_cast<sockaddr *>(&addr), sizeof(sockaddr_un)) == -1) {
-        disconnect();
-        Status st = Status(1, std::string("Unable to connect to the UNIX socket ") + path + ": " + strerror(errno));
-        return std::make_pair(nullptr, st);
+    if (useShm) {
+        shm.reset(new ShmChannel());
+        Status st = shm->create();
+        if (st.isError()) {
+            disconnect();
+            return std::make_pair(nullptr, st);
+        }
     }
 
     connectedUri = uri;
@@ -80,7 +249,7 @@ std::pair<SystemInfo *, Status> RouterClient::connect(const std::string &uri, co
     o << STR1(SIM_ID);
 #endif
 
-    flatbuffers::FlatBufferBuilder builder(1024);
+    flatbuffers::FlatBufferBuilder &builder = controlBuilder();
     auto bName = builder.CreateString(name);
     auto sysName = builder.CreateString(o.str());
     auto hName = builder.CreateString(sysInfo.nodename);
@@ -89,6 +258,10 @@ std::pair<SystemInfo *, Status> RouterClient::connect(const std::string &uri, co
     siBuilder.add_systemName(sysName);
     siBuilder.add_pid(getpid());
     siBuilder.add_hostname(hName);
+    siBuilder.add_shmSize(shm ? shm->getCapacity() : 0);
+    siBuilder.add_encodings(SUPPORTED_ENCODINGS);
+    siBuilder.add_stripes(stripes);
+    siBuilder.add_splitChannels(splitChannels);
     auto si = siBuilder.Finish();
 
     sw_axi::wire::MessageBuilder msgBuilder(builder);
@@ -102,6 +275,12 @@ std::pair<SystemInfo *, Status> RouterClient::connect(const std::string &uri, co
         return std::make_pair(nullptr, st);
     }
 
+    if (shm && sendFd(sock, shm->getFd()) == -1) {
+        disconnect();
+        Status st = Status(1, std::string("Error while passing the shared memory segment: ") + strerror(errno));
+        return std::make_pair(nullptr, st);
+    }
+
     std::vector<uint8_t> data;
     if (readFromSocket(sock, data) == -1) {
         disconnect();
@@ -116,6 +295,22 @@ std::pair<SystemInfo *, Status> RouterClient::connect(const std::string &uri, co
         return std::make_pair(nullptr, st);
     }
 
+    if (shm) {
+        if (msg->systemInfo()->shmSize() != shm->getCapacity()) {
+            disconnect();
+            return std::make_pair(nullptr, Status(1, "The router refused the shared memory transport"));
+        }
+        shm->tx().setLivenessSocket(sock);
+        shm->rx().setLivenessSocket(sock);
+    }
+
+    encodings = SUPPORTED_ENCODINGS;
+    clientId = msg->clientId();
+    st = setUpTransport();
+    if (st.isError()) {
+        return std::make_pair(nullptr, st);
+    }
+
     SystemInfo *routerInfo = new SystemInfo();
     routerInfo->name = msg->systemInfo()->name()->str();
     routerInfo->systemName = msg->systemInfo()->systemName()->str();
@@ -126,18 +321,139 @@ std::pair<SystemInfo *, Status> RouterClient::connect(const std::string &uri, co
     return std::make_pair(routerInfo, Status());
 }
 
-std::pair<uint64_t, Status> RouterClient::registerIp(const IpConfig &config) {
+Status RouterClient::attach(const RouterClient &control, uint32_t index) {
+    if (state != State::DISCONNECTED) {
+        return Status(1, "The client needs to be disconnected for the attach operation to proceed");
+    }
+
+    if (control.state != State::STARTED) {
+        return Status(1, "Data connections can only be attached to a started client");
+    }
+
+    if (control.shm) {
+        return Status(1, "Only the unix:// transport can use multiple connections");
+    }
+
+    Status st = openSocket(control.connectedUri.substr(7));
+    if (st.isError()) {
+        return st;
+    }
+
+    flatbuffers::FlatBufferBuilder &builder = controlBuilder();
+    sw_axi::wire::MessageBuilder msgBuilder(builder);
+    msgBuilder.add_type(sw_axi::wire::Type_ATTACH);
+    msgBuilder.add_clientId(control.clientId);
+    msgBuilder.add_stripe(index);
+    builder.Finish(msgBuilder.Finish());
+
+    if (writeToSocket(sock, builder.GetBufferPointer(), builder.GetSize()) == -1) {
+        disconnect();
+        return Status(1, std::string("Error while sending the ATTACH message: ") + strerror(errno));
+    }
+
+    std::vector<uint8_t> data;
+    if (readFromSocket(sock, data) == -1) {
+        disconnect();
+        return Status(1, std::string("Error while receiving the attach acknowledgement: ") + strerror(errno));
+    }
+
+    auto msg = wire::GetMessage(data.data());
+    if (msg->type() == wire::Type_ERROR) {
+        std::string error = "Cannot attach a data connection: " + msg->errorMessage()->str();
+        disconnect();
+        return Status(1, error);
+    }
+
+    if (msg->type() != wire::Type_ACK) {
+        disconnect();
+        return Status(1, "Got an unexpected response while attaching: " + std::to_string(int(msg->type())));
+    }
+
+    connectedUri = control.connectedUri;
+    clientId = control.clientId;
+    encodings = control.encodings;
+    busyPollMicros = control.busyPollMicros;
+    st = setUpTransport();
+    if (st.isError()) {
+        return st;
+    }
+    state = State::STARTED;
+    return Status();
+}
+
+Status RouterClient::openSocket(const std::string &path) {
+    sockaddr_un addr;
+    if (path.length() > sizeof(addr.sun_path) - 1) {
+        return Status(1, "Path too long: " + path);
+    }
+
+    sock = socket(AF_UNIX, SOCK_STREAM, 0);
+    if (sock == -1) {
+        return Status(1, std::string("Unable to create a UNIX socket: ") + strerror(errno));
+    }
+
+    memset(&addr, 0, sizeof(sockaddr_un));
+    addr.sun_family = AF_UNIX;
+    strncpy(addr.sun_path, path.c_str(), sizeof(addr.sun_path) - 1);
+
+    if (::connect(sock, reinterpret_cast<sockaddr *>(&addr), sizeof(sockaddr_un)) == -1) {
+        disconnect();
+        return Status(1, std::string("Unable to connect to the UNIX socket ") + path + ": " + strerror(errno));
+    }
+    return Status();
+}
+
+Status RouterClient::setUpTransport() {
+    frameWriter.reset(sock);
+    frameReader.reset(sock);
+    // The router fills in the target of a request in place, so the field has to be present even when it is zero
+    batchBuilder.Clear();
+    batchBuilder.ForceDefaults(true);
+    batch.clear();
+    rxBatch = nullptr;
+    buildTxnTemplate();
+
+    // Busy polling spins on a non-blocking socket or on the shared memory rings; io_uring would put the threads to
+    // sleep in the kernel instead, so it is not used in this mode
+    if (busyPollMicros) {
+        if (shm) {
+            shm->tx().setBusyPoll(busyPollMicros);
+            shm->rx().setBusyPoll(busyPollMicros);
+        } else if (setNonBlocking(sock) == -1) {
+            disconnect();
+            return Status(1, std::string("Unable to make the socket non-blocking: ") + strerror(errno));
+        }
+        frameReader.setBusyPoll(busyPollMicros);
+    }
+
+    // The rings are set up before any framed message arrives, so nothing is left behind in the frame reader. If the
+    // kernel cannot provide what we need, we stay with the plain socket calls.
+    uringWriter.reset();
+    uringReader.reset();
+    if (!shm && !busyPollMicros && UringFrameWriter::isAvailable()) {
+        uringWriter.reset(new UringFrameWriter());
+        uringReader.reset(new UringFrameReader());
+        if (uringWriter->init(sock) == -1 || uringReader->init(sock) == -1) {
+            uringWriter.reset();
+            uringReader.reset();
+        }
+    }
+    return Status();
+}
+
+std::pair<uint64_t, Status> RouterClient::registerIp(const IpConfig &config, uint32_t *credits) {
     if (state != State::CONNECTED) {
         Status st = Status(1, "Can register slaves only in CONNECTED mode");
         return std::make_pair(0, st);
     }
 
-    flatbuffers::FlatBufferBuilder builder(1024);
+    flatbuffers::FlatBufferBuilder &builder = controlBuilder();
     auto fbName = builder.CreateString(config.name);
     sw_axi::wire::IpInfoBuilder ipBuilder(builder);
     ipBuilder.add_name(fbName);
     ipBuilder.add_address(config.address);
     ipBuilder.add_size(config.size);
+    ipBuilder.add_maxOutstanding(config.maxOutstanding);
 
     if (config.implementation == IpImplementation::SOFTWARE) {
         ipBuilder.add_implementation(wire::ImplementationType_SOFTWARE);
@@ -175,14 +491,14 @@ std::pair<uint64_t, Status> RouterClient::registerIp(const IpConfig &config) {
     msgBuilder.add_ipInfo(ip);
     builder.Finish(msgBuilder.Finish());
 
-    if (sw_axi::writeToSocket(sock, builder.GetBufferPointer(), builder.GetSize()) == -1) {
+    if (sendMessage(builder.GetBufferPointer(), builder.GetSize()) == -1) {
         disconnect();
         Status st = Status(1, std::string("Error while sending the IP_INFO message to router: ") + strerror(errno));
         return std::make_pair(0, st);
     }
 
     std::vector<uint8_t> data;
-    if (readFromSocket(sock, data) == -1) {
+    if (receiveMessage(data) == -1) {
         disconnect();
         Status st = Status(1, std::string("Error while receiving response to IP registration ") + strerror(errno));
         return std::make_pair(0, st);
@@ -203,6 +519,9 @@ std::pair<uint64_t, Status> RouterClient::registerIp(const IpConfig &config) {
         return std::make_pair(0, Status(1, o.str()));
     }
 
+    if (credits) {
+        *credits = msg->credits();
+    }
     return std::make_pair(msg->ipId(), Status());
 }
 
@@ -211,18 +530,18 @@ Status RouterClient::commitIp() {
         return Status(1, "Can commit slaves only in CONNECTED mode");
     }
 
-    flatbuffers::FlatBufferBuilder builder(1024);
+    flatbuffers::FlatBufferBuilder &builder = controlBuilder();
     sw_axi::wire::MessageBuilder msgBuilder(builder);
     msgBuilder.add_type(sw_axi::wire::Type_COMMIT);
     builder.Finish(msgBuilder.Finish());
 
-    if (sw_axi::writeToSocket(sock, builder.GetBufferPointer(), builder.GetSize()) == -1) {
+    if (sendMessage(builder.GetBufferPointer(), builder.GetSize()) == -1) {
         disconnect();
         return Status(1, std::string("Error while sending the COMMIT message: ") + strerror(errno));
     }
 
     std::vector<uint8_t> data;
-    if (readFromSocket(sock, data) == -1) {
+    if (receiveMessage(data) == -1) {
         disconnect();
         return Status(1, std::string("Error while receiving commit acknowledgement: ") + strerror(errno));
     }
@@ -256,7 +575,7 @@ std::pair<SystemInfo *, Status> RouterClient::retrievePeerInfo() {
     std::vector<uint8_t> data;
     const wire::Message *msg;
 
-    if (readFromSocket(sock, data) == -1) {
+    if (receiveMessage(data) == -1) {
         disconnect();
         Status st = Status(1, std::string("Error while receiving the peer info: ") + strerror(errno));
         return std::make_pair(nullptr, st);
@@ -269,6 +588,8 @@ std::pair<SystemInfo *, Status> RouterClient::retrievePeerInfo() {
         si->systemName = msg->systemInfo()->systemName()->str();
         si->pid = msg->systemInfo()->pid();
         si->hostname = msg->systemInfo()->hostname()->str();
+        // The router forwards the payloads untouched, so we can only use the encodings all the peers understand
+        encodings &= msg->systemInfo()->encodings();
         return std::make_pair(si, Status());
     }
 
@@ -300,7 +621,7 @@ std::pair<IpConfig *, Status> RouterClient::retrieveIpConfig() {
     std::vector<uint8_t> data;
     const wire::Message *msg;
 
-    if (readFromSocket(sock, data) == -1) {
+    if (receiveMessage(data) == -1) {
         disconnect();
         Status st = Status(1, std::string("Error while receiving the IP info: ") + strerror(errno));
         return std::make_pair(nullptr, st);
@@ -366,94 +687,281 @@ std::pair<IpConfig *, Status> RouterClient::retrieveIpConfig() {
 }
 
 std::pair<Transaction *, Status> RouterClient::receiveTransaction() {
-    if (state != State::STARTED) {
-        Status st = Status(1, "The client needs be started befor receiving transactions");
-        return std::make_pair(nullptr, st);
+    std::pair<TransactionView, Status> ret = receiveTransactionView();
+    if (ret.second.isError()) {
+        return std::make_pair(nullptr, ret.second);
     }
 
-    std::vector<uint8_t> data;
-    const wire::Message *msg;
+    Transaction *txn = new Transaction();
+    ret.first.copyTo(*txn);
+    return std::make_pair(txn, Status());
+}
 
-    if (readFromSocket(sock, data) == -1) {
-        disconnect();
-        Status st = Status(1, std::string("Error while receiving a transaction: ") + strerror(errno));
-        return std::make_pair(nullptr, st);
+std::pair<TransactionView, Status> RouterClient::receiveTransactionView() {
+    TransactionView view;
+    if (state != State::STARTED) {
+        Status st = Status(1, "The client needs be started befor receiving transactions");
+        return std::make_pair(view, st);
     }
-    msg = wire::GetMessage(data.data());
 
-    if (msg->type() == wire::Type_DONE) {
-        return std::make_pair(nullptr, Status(DONE, "Done processing"));
-    }
+    // Hand out the rest of the batch received last time before reading another message
+    const wire::Transaction *txn = nullptr;
+    auto batchTxns = static_cast<const flatbuffers::Vector<flatbuffers::Offset<wire::Transaction>> *>(rxBatch);
+    if (batchTxns && rxBatchPos < batchTxns->size()) {
+        txn = batchTxns->Get(rxBatchPos++);
+    } else {
+        rxBatch = nullptr;
+        const wire::Message *msg;
+
+        // The stream traffic and the interrupts are handed over to the handlers as they come in between the
+        // transactions
+        while (true) {
+            const uint8_t *frame = receiveFrame();
+            if (!frame) {
+                disconnect();
+                Status st = Status(1, std::string("Error while receiving a transaction: ") + strerror(errno));
+                return std::make_pair(view, st);
+            }
+            msg = wire::GetMessage(frame);
+
+            if (msg->type() == wire::Type_INTERRUPT && interruptHandler) {
+                Status st = interruptHandler(msg->interrupt(), msg->raises());
+                if (st.isError()) {
+                    return std::make_pair(view, st);
+                }
+                continue;
+            }
+
+            bool isFence = msg->type() == wire::Type_FENCE_REQ || msg->type() == wire::Type_FENCE_RESP;
+            if (isFence && fenceHandler) {
+                Status st = fenceHandler(msg->ipId(), msg->type() == wire::Type_FENCE_RESP);
+                if (st.isError()) {
+                    return std::make_pair(view, st);
+                }
+                continue;
+            }
+
+            bool isStream = msg->type() == wire::Type_STREAM || msg->type() == wire::Type_STREAM_CREDIT;
+            if (!isStream || !streamHandler) {
+                break;
+            }
+            if (msg->type() == wire::Type_STREAM && !msg->chunk()) {
+                disconnect();
+                return std::make_pair(view, Status(1, "Received a STREAM message without data"));
+            }
+
+            StreamView stream;
+            stream.msg = msg;
+            Status st = streamHandler(stream);
+            if (st.isError()) {
+                return std::make_pair(view, st);
+            }
+        }
 
-    if (msg->type() != wire::Type_TRANSACTION) {
-        std::ostringstream o;
-        o << "Got an unexpected response instead of a transaction: " << msg->type();
-        disconnect();
-        return std::make_pair(nullptr, Status(1, o.str()));
+        if (msg->type() == wire::Type_DONE) {
+            return std::make_pair(view, Status(DONE, "Done processing"));
+        }
+
+        if (msg->type() == wire::Type_TRANSACTION) {
+            txn = msg->txn();
+            if (directPayload) {
+                view.payload = directPayload;
+                view.payloadSize = txn->data()->size();
+            }
+        } else if (msg->type() == wire::Type_TRANSACTION_BATCH && msg->txns() && msg->txns()->size()) {
+            rxBatch = msg->txns();
+            rxBatchPos = 1;
+            txn = msg->txns()->Get(0);
+        } else {
+            std::ostringstream o;
+            o << "Got an unexpected response instead of a transaction: " << msg->type();
+            disconnect();
+            return std::make_pair(view, Status(1, o.str()));
+        }
     }
-    Transaction *txn = new Transaction();
 
-    switch (msg->txn()->type()) {
+    switch (txn->type()) {
     case wire::TransactionType_READ_REQ:
-        txn->type = TransactionType::READ_REQ;
+        view.type = TransactionType::READ_REQ;
         break;
     case wire::TransactionType_WRITE_REQ:
-        txn->type = TransactionType::WRITE_REQ;
+        view.type = TransactionType::WRITE_REQ;
         break;
     case wire::TransactionType_READ_RESP:
-        txn->type = TransactionType::READ_RESP;
+        view.type = TransactionType::READ_RESP;
         break;
     case wire::TransactionType_WRITE_RESP:
-        txn->type = TransactionType::WRITE_RESP;
+        view.type = TransactionType::WRITE_RESP;
         break;
     default:
-        Status st = Status(1, "Received a transaction of unknown type: " + std::to_string(int(msg->txn()->type())));
-        return std::make_pair(nullptr, st);
+        Status st = Status(1, "Received a transaction of unknown type: " + std::to_string(int(txn->type())));
+        return std::make_pair(view, st);
     }
 
-    txn->initiator = msg->txn()->initiator();
-    txn->target = msg->txn()->target();
-    txn->id = msg->txn()->id();
-    txn->address = msg->txn()->address();
-    txn->size = msg->txn()->size();
+    if (txn->encoding() != wire::PayloadEncoding_RAW) {
+        if (txn->encoding() != wire::PayloadEncoding_RLE || !txn->data()) {
+            disconnect();
+            return std::make_pair(view, Status(1, "Received a payload in an unknown encoding"));
+        }
+
+        uint8_t *dest = nullptr;
+        if (readSink && view.type == TransactionType::READ_RESP && txn->ok()) {
+            dest = readSink(txn->initiator(), txn->id(), txn->size());
+        }
+        if (!dest) {
+            decodeBuffer.resize(txn->size());
+            dest = decodeBuffer.data();
+        }
 
-    if (msg->txn()->data()) {
-        txn->data.resize(msg->txn()->data()->size());
-        memcpy(txn->data.data(), msg->txn()->data()->Data(), msg->txn()->data()->size());
+        if (decodeRle(txn->data()->Data(), txn->data()->size(), dest, txn->size()) == -1) {
+            disconnect();
+            return std::make_pair(view, Status(1, "Received a malformed run-length encoded payload"));
+        }
+        view.payload = dest;
+        view.payloadSize = txn->size();
     }
-    txn->ok = msg->txn()->ok();
-    txn->message = msg->txn()->message()->str();
 
-    return std::make_pair(txn, Status());
+    view.txn = txn;
+    return std::make_pair(view, Status());
 }
 
-Status RouterClient::sendTransaction(const Transaction &txn) {
+Status RouterClient::sendTransaction(const Transaction &txn, bool flush) {
     if (state != State::STARTED) {
         return Status(1, "The client needs be started befor sending transactions");
     }
 
-    flatbuffers::FlatBufferBuilder builder(1024);
-    auto errMsg = builder.CreateString(txn.message);
-    auto data = builder.CreateVector(txn.data.data(), txn.data.size());
-
-    sw_axi::wire::TransactionBuilder txnBuilder(builder);
+    wire::TransactionType type;
     switch (txn.type) {
     case TransactionType::READ_REQ:
-        txnBuilder.add_type(wire::TransactionType_READ_REQ);
+        type = wire::TransactionType_READ_REQ;
         break;
     case TransactionType::WRITE_REQ:
-        txnBuilder.add_type(wire::TransactionType_WRITE_REQ);
+        type = wire::TransactionType_WRITE_REQ;
         break;
     case TransactionType::READ_RESP:
-        txnBuilder.add_type(wire::TransactionType_READ_RESP);
+        type = wire::TransactionType_READ_RESP;
         break;
     case TransactionType::WRITE_RESP:
-        txnBuilder.add_type(wire::TransactionType_WRITE_RESP);
+        type = wire::TransactionType_WRITE_RESP;
         break;
     default:
         return Status(1, "Unknown transaction type: " + std::to_string(int(txn.type)));
     }
 
+    const uint8_t *payload = txn.external ? txn.external : txn.data.data();
+    size_t payloadSize = txn.external ? txn.size : txn.data.size();
+    bool inPlace = txn.external;
+
+    wire::PayloadEncoding encoding = wire::PayloadEncoding_RAW;
+    if ((encodings & (1u << wire::PayloadEncoding_RLE)) && payloadSize >= ENCODE_THRESHOLD && payloadSize == txn.size) {
+        size_t encodedSize = encodeRle(payload, payloadSize, encodeBuffer);
+        if (encodedSize) {
+            encoding = wire::PayloadEncoding_RLE;
+            payload = encodeBuffer.data();
+            payloadSize = encodedSize;
+            inPlace = false;
+        }
+    }
+
+    // The length of a large payload vector is pushed first, so that it ends up last in the message, and the payload
+    // itself is gathered right behind it when the message is written out. Since the payload is padded to 8 bytes,
+    // the alignment of everything that precedes it is preserved.
+    if (payloadSize >= TAIL_PAYLOAD_THRESHOLD || (inPlace && payloadSize)) {
+        if (sendBatch(false) == -1) {
+            disconnect();
+            return Status(1, std::string("Error while sending the TRANSACTION message: ") + strerror(errno));
+        }
+
+        auto data = flatbuffers::Offset<flatbuffers::Vector<uint8_t>>(
+                batchBuilder.PushElement<flatbuffers::uoffset_t>(payloadSize));
+        flatbuffers::Offset<flatbuffers::String> errMsg;
+        flatbuffers::Offset<flatbuffers::Vector<uint8_t>> strobe;
+        if (!txn.message.empty()) {
+            errMsg = batchBuilder.CreateString(txn.message);
+        }
+        if (!txn.strobe.empty()) {
+            strobe = batchBuilder.CreateVector(txn.strobe);
+        }
+
+        sw_axi::wire::TransactionBuilder txnBuilder(batchBuilder);
+        txnBuilder.add_type(type);
+        txnBuilder.add_initiator(txn.initiator);
+        txnBuilder.add_target(txn.target);
+        txnBuilder.add_id(txn.id);
+        txnBuilder.add_address(txn.address);
+        txnBuilder.add_size(txn.size);
+        txnBuilder.add_data(data);
+        txnBuilder.add_ok(txn.ok);
+        txnBuilder.add_message(errMsg);
+        txnBuilder.add_encoding(encoding);
+        txnBuilder.add_qos(txn.qos);
+        txnBuilder.add_burstLength(txn.burstLength);
+        txnBuilder.add_burstSize(txn.burstSize);
+        txnBuilder.add_burst(static_cast<wire::BurstType>(txn.burst));
+        txnBuilder.add_axiId(txn.axiId);
+        txnBuilder.add_strobe(strobe);
+        txnBuilder.add_posted(txn.posted);
+        auto txnData = txnBuilder.Finish();
+
+        sw_axi::wire::MessageBuilder msgBuilder(batchBuilder);
+        msgBuilder.add_type(sw_axi::wire::Type_TRANSACTION);
+        msgBuilder.add_txn(txnData);
+        batchBuilder.Finish(msgBuilder.Finish());
+
+        static const uint64_t padding = 0;
+        iovec iov[3] = {
+                {batchBuilder.GetBufferPointer(), batchBuilder.GetSize()},
+                {const_cast<uint8_t *>(payload), payloadSize},
+                {const_cast<uint64_t *>(&padding), (8 - payloadSize % 8) % 8}};
+        int ret = sendMessage(iov, 3, flush);
+        batchBuilder.Clear();
+
+        if (ret == -1) {
+            disconnect();
+            return Status(1, std::string("Error while sending the TRANSACTION message: ") + strerror(errno));
+        }
+        return Status();
+    }
+
+    // A header-only transaction sent on its own is patched into the pre-serialized message
+    if (flush && batch.empty() && !payloadSize && txn.message.empty() && txn.strobe.empty()) {
+        wire::Transaction *t = wire::GetMutableMessage(txnTemplate.data())->mutable_txn();
+        t->mutate_type(type);
+        t->mutate_initiator(txn.initiator);
+        t->mutate_target(txn.target);
+        t->mutate_id(txn.id);
+        t->mutate_address(txn.address);
+        t->mutate_size(txn.size);
+        t->mutate_ok(txn.ok);
+        t->mutate_qos(txn.qos);
+        t->mutate_burstLength(txn.burstLength);
+        t->mutate_burstSize(txn.burstSize);
+        t->mutate_burst(static_cast<wire::BurstType>(txn.burst));
+        t->mutate_axiId(txn.axiId);
+        t->mutate_posted(txn.posted);
+
+        if (sendMessage(txnTemplate.data(), txnTemplate.size()) == -1) {
+            disconnect();
+            return Status(1, std::string("Error while sending the TRANSACTION message: ") + strerror(errno));
+        }
+        return Status();
+    }
+
+    flatbuffers::Offset<flatbuffers::String> errMsg;
+    flatbuffers::Offset<flatbuffers::Vector<uint8_t>> data;
+    flatbuffers::Offset<flatbuffers::Vector<uint8_t>> strobe;
+    if (!txn.message.empty()) {
+        errMsg = batchBuilder.CreateString(txn.message);
+    }
+    if (payloadSize) {
+        data = batchBuilder.CreateVector(payload, payloadSize);
+    }
+    if (!txn.strobe.empty()) {
+        strobe = batchBuilder.CreateVector(txn.strobe);
+    }
+
+    sw_axi::wire::TransactionBuilder txnBuilder(batchBuilder);
+    txnBuilder.add_type(type);
     txnBuilder.add_initiator(txn.initiator);
     txnBuilder.add_target(txn.target);
     txnBuilder.add_id(txn.id);
@@ -462,49 +970,185 @@ Status RouterClient::sendTransaction(const Transaction &txn) {
     txnBuilder.add_data(data);
     txnBuilder.add_ok(txn.ok);
     txnBuilder.add_message(errMsg);
-    auto txnData = txnBuilder.Finish();
-
-    sw_axi::wire::MessageBuilder msgBuilder(builder);
-    msgBuilder.add_type(sw_axi::wire::Type_TRANSACTION);
-    msgBuilder.add_txn(txnData);
-    builder.Finish(msgBuilder.Finish());
+    txnBuilder.add_encoding(encoding);
+    txnBuilder.add_qos(txn.qos);
+    txnBuilder.add_burstLength(txn.burstLength);
+    txnBuilder.add_burstSize(txn.burstSize);
+    txnBuilder.add_burst(static_cast<wire::BurstType>(txn.burst));
+    txnBuilder.add_axiId(txn.axiId);
+    txnBuilder.add_strobe(strobe);
+    txnBuilder.add_posted(txn.posted);
+    batch.push_back(txnBuilder.Finish());
+
+    if (!flush && batch.size() < MAX_BATCH_LENGTH && batchBuilder.GetSize() < MAX_BATCH_BYTES) {
+        return Status();
+    }
 
-    if (sw_axi::writeToSocket(sock, builder.GetBufferPointer(), builder.GetSize()) == -1) {
+    if (sendBatch(flush) == -1) {
         disconnect();
-        return Status(1, std::string("Error while sending the TERMINATE message: ") + strerror(errno));
+        return Status(1, std::string("Error while sending the TRANSACTION message: ") + strerror(errno));
     }
     return Status();
 }
 
-Status RouterClient::sendTermination(uint64_t id) {
+Status RouterClient::sendTermination(uint64_t id, bool flush) {
     if (state != State::STARTED) {
         return Status(1, "The client needs be started before sending termination messages");
     }
 
-    flatbuffers::FlatBufferBuilder builder(1024);
+    if (sendBatch(false) == -1) {
+        disconnect();
+        return Status(1, std::string("Error while sending the TRANSACTION message: ") + strerror(errno));
+    }
+
+    flatbuffers::FlatBufferBuilder &builder = controlBuilder();
     sw_axi::wire::MessageBuilder msgBuilder(builder);
     msgBuilder.add_type(sw_axi::wire::Type_TERMINATE);
     msgBuilder.add_ipId(id);
     builder.Finish(msgBuilder.Finish());
 
-    if (sw_axi::writeToSocket(sock, builder.GetBufferPointer(), builder.GetSize()) == -1) {
+    if (sendMessage(builder.GetBufferPointer(), builder.GetSize(), flush) == -1) {
         disconnect();
         return Status(1, std::string("Error while sending the TERMINATE message: ") + strerror(errno));
     }
     return Status();
 }
 
+Status RouterClient::sendStreamChunk(const StreamChunk &chunk, bool flush) {
+    if (state != State::STARTED) {
+        return Status(1, "The client needs be started before sending stream data");
+    }
+
+    if (sendBatch(false) == -1) {
+        disconnect();
+        return Status(1, std::string("Error while sending the TRANSACTION message: ") + strerror(errno));
+    }
+
+    // The payload is always gathered behind the message, as for large transactions
+    auto data = flatbuffers::Offset<flatbuffers::Vector<uint8_t>>(
+            batchBuilder.PushElement<flatbuffers::uoffset_t>(chunk.size));
+    flatbuffers::Offset<flatbuffers::Vector<uint8_t>> keep;
+    if (chunk.keep) {
+        keep = batchBuilder.CreateVector(chunk.keep, (chunk.size + 7) / 8);
+    }
+
+    sw_axi::wire::StreamChunkBuilder chunkBuilder(batchBuilder);
+    chunkBuilder.add_initiator(chunk.initiator);
+    chunkBuilder.add_target(0);
+    chunkBuilder.add_address(chunk.address);
+    chunkBuilder.add_data(data);
+    chunkBuilder.add_keep(keep);
+    chunkBuilder.add_user(chunk.user);
+    chunkBuilder.add_last(chunk.last);
+    chunkBuilder.add_more(chunk.more);
+    auto chunkData = chunkBuilder.Finish();
+
+    sw_axi::wire::MessageBuilder msgBuilder(batchBuilder);
+    msgBuilder.add_type(sw_axi::wire::Type_STREAM);
+    msgBuilder.add_chunk(chunkData);
+    batchBuilder.Finish(msgBuilder.Finish());
+
+    static const uint64_t padding = 0;
+    iovec iov[3] = {
+            {batchBuilder.GetBufferPointer(), batchBuilder.GetSize()},
+            {const_cast<uint8_t *>(chunk.data), chunk.size},
+            {const_cast<uint64_t *>(&padding), (8 - chunk.size % 8) % 8}};
+    int ret = sendMessage(iov, 3, flush);
+    batchBuilder.Clear();
+
+    if (ret == -1) {
+        disconnect();
+        return Status(1, std::string("Error while sending the STREAM message: ") + strerror(errno));
+    }
+    return Status();
+}
+
+Status RouterClient::sendStreamCredit(uint64_t master, uint32_t credits, bool flush) {
+    if (state != State::STARTED) {
+        return Status(1, "The client needs be started before sending stream credits");
+    }
+
+    if (sendBatch(false) == -1) {
+        disconnect();
+        return Status(1, std::string("Error while sending the TRANSACTION message: ") + strerror(errno));
+    }
+
+    flatbuffers::FlatBufferBuilder &builder = controlBuilder();
+    sw_axi::wire::MessageBuilder msgBuilder(builder);
+    msgBuilder.add_type(sw_axi::wire::Type_STREAM_CREDIT);
+    msgBuilder.add_ipId(master);
+    msgBuilder.add_credits(credits);
+    builder.Finish(msgBuilder.Finish());
+
+    if (sendMessage(builder.GetBufferPointer(), builder.GetSize(), flush) == -1) {
+        disconnect();
+        return Status(1, std::string("Error while sending the STREAM_CREDIT message: ") + strerror(errno));
+    }
+    return Status();
+}
+
+Status RouterClient::sendInterrupt(uint32_t number, bool flush) {
+    if (state != State::STARTED) {
+        return Status(1, "The client needs be started before raising interrupts");
+    }
+
+    if (sendBatch(false) == -1) {
+        disconnect();
+        return Status(1, std::string("Error while sending the TRANSACTION message: ") + strerror(errno));
+    }
+
+    flatbuffers::FlatBufferBuilder &builder = controlBuilder();
+    sw_axi::wire::MessageBuilder msgBuilder(builder);
+    msgBuilder.add_type(sw_axi::wire::Type_INTERRUPT);
+    msgBuilder.add_interrupt(number);
+    builder.Finish(msgBuilder.Finish());
+
+    if (sendMessage(builder.GetBufferPointer(), builder.GetSize(), flush) == -1) {
+        disconnect();
+        return Status(1, std::string("Error while sending the INTERRUPT message: ") + strerror(errno));
+    }
+    return Status();
+}
+
+Status RouterClient::sendFence(uint64_t master, bool response, bool flush) {
+    if (state != State::STARTED) {
+        return Status(1, "The client needs be started before sending fences");
+    }
+
+    if (sendBatch(false) == -1) {
+        disconnect();
+        return Status(1, std::string("Error while sending the TRANSACTION message: ") + strerror(errno));
+    }
+
+    flatbuffers::FlatBufferBuilder &builder = controlBuilder();
+    sw_axi::wire::MessageBuilder msgBuilder(builder);
+    msgBuilder.add_type(response ? sw_axi::wire::Type_FENCE_RESP : sw_axi::wire::Type_FENCE_REQ);
+    msgBuilder.add_ipId(master);
+    builder.Finish(msgBuilder.Finish());
+
+    if (sendMessage(builder.GetBufferPointer(), builder.GetSize(), flush) == -1) {
+        disconnect();
+        return Status(1, std::string("Error while sending the FENCE message: ") + strerror(errno));
+    }
+    return Status();
+}
+
 Status RouterClient::sendLogout() {
     if (state != State::STARTED) {
         return Status(1, "The client needs be started before logging out");
     }
 
-    flatbuffers::FlatBufferBuilder builder(1024);
+    if (sendBatch(false) == -1) {
+        disconnect();
+        return Status(1, std::string("Error while sending the TRANSACTION message: ") + strerror(errno));
+    }
+
+    flatbuffers::FlatBufferBuilder &builder = controlBuilder();
     sw_axi::wire::MessageBuilder msgBuilder(builder);
     msgBuilder.add_type(sw_axi::wire::Type_DONE);
     builder.Finish(msgBuilder.Finish());
 
-    if (sw_axi::writeToSocket(sock, builder.GetBufferPointer(), builder.GetSize()) == -1) {
+    if (sendMessage(builder.GetBufferPointer(), builder.GetSize()) == -1) {
         disconnect();
         return Status(1, std::string("Error while sending the DONE message: ") + strerror(errno));
     }
@@ -513,15 +1157,212 @@ Status RouterClient::sendLogout() {
     return Status();
 }
 
+Status RouterClient::flush() {
+    if (state != State::STARTED) {
+        return Status(1, "The client needs be started before flushing messages");
+    }
+
+    if (sendBatch(false) == -1) {
+        disconnect();
+        return Status(1, std::string("Error while sending the TRANSACTION message: ") + strerror(errno));
+    }
+
+    if (shm) {
+        return Status();
+    }
+
+    if ((uringWriter ? uringWriter->flush() : frameWriter.flush()) == -1) {
+        disconnect();
+        return Status(1, std::string("Error while flushing messages: ") + strerror(errno));
+    }
+    return Status();
+}
+
+void RouterClient::buildTxnTemplate() {
+    // All the header fields need to be present in the buffer for the mutators to work
+    flatbuffers::FlatBufferBuilder builder(256);
+    builder.ForceDefaults(true);
+
+    sw_axi::wire::TransactionBuilder txnBuilder(builder);
+    txnBuilder.add_type(wire::TransactionType_READ_REQ);
+    txnBuilder.add_initiator(0);
+    txnBuilder.add_target(0);
+    txnBuilder.add_id(0);
+    txnBuilder.add_address(0);
+    txnBuilder.add_size(0);
+    txnBuilder.add_ok(true);
+    txnBuilder.add_qos(0);
+    txnBuilder.add_burstLength(0);
+    txnBuilder.add_burstSize(0);
+    txnBuilder.add_burst(wire::BurstType_INCR);
+    txnBuilder.add_axiId(0);
+    txnBuilder.add_posted(false);
+    auto txnData = txnBuilder.Finish();
+
+    sw_axi::wire::MessageBuilder msgBuilder(builder);
+    msgBuilder.add_type(sw_axi::wire::Type_TRANSACTION);
+    msgBuilder.add_txn(txnData);
+    builder.Finish(msgBuilder.Finish());
+
+    txnTemplate.assign(builder.GetBufferPointer(), builder.GetBufferPointer() + builder.GetSize());
+}
+
+int RouterClient::sendBatch(bool flush) {
+    if (batch.empty()) {
+        return 0;
+    }
+
+    // A lone transaction goes out in the plain form that every peer understands
+    flatbuffers::Offset<flatbuffers::Vector<flatbuffers::Offset<wire::Transaction>>> txns;
+    if (batch.size() > 1) {
+        txns = batchBuilder.CreateVector(batch);
+    }
+
+    sw_axi::wire::MessageBuilder msgBuilder(batchBuilder);
+    if (batch.size() > 1) {
+        msgBuilder.add_type(sw_axi::wire::Type_TRANSACTION_BATCH);
+        msgBuilder.add_txns(txns);
+    } else {
+        msgBuilder.add_type(sw_axi::wire::Type_TRANSACTION);
+        msgBuilder.add_txn(batch.front());
+    }
+    batchBuilder.Finish(msgBuilder.Finish());
+
+    int ret = sendMessage(batchBuilder.GetBufferPointer(), batchBuilder.GetSize(), flush);
+    batchBuilder.Clear();
+    batch.clear();
+    return ret;
+}
+
+void RouterClient::bindToLocalNode() {
+    frameReader.bindToLocalNode();
+    if (uringReader) {
+        uringReader->bindToLocalNode();
+    }
+    moveToLocalNode(decodeBuffer.data(), decodeBuffer.capacity());
+}
+
+void RouterClient::setReadSink(ReadSink sink) {
+    readSink = sink;
+    if (!readSink) {
+        readSplitter = FrameReader::TailSplitter();
+        return;
+    }
+    readSplitter = [this](const uint8_t *head, size_t headSize, size_t size, uint8_t *&dest, size_t &destSize) {
+        return splitReadResponse(head, headSize, size, dest, destSize);
+    };
+}
+
+size_t RouterClient::splitReadResponse(
+        const uint8_t *head,
+        size_t headSize,
+        size_t size,
+        uint8_t *&dest,
+        size_t &destSize) {
+    // Only the head of the frame is there, so make sure that the root table is in it before looking further
+    uint32_t root;
+    memcpy(&root, head, sizeof(root));
+    if (root >= headSize) {
+        return 0;
+    }
+
+    const wire::Message *msg = wire::GetMessage(head);
+    if (msg->type() != wire::Type_TRANSACTION || !msg->txn()) {
+        return 0;
+    }
+
+    const wire::Transaction *txn = msg->txn();
+    if (txn->type() != wire::TransactionType_READ_RESP || !txn->ok() || !txn->data() ||
+        txn->encoding() != wire::PayloadEncoding_RAW) {
+        return 0;
+    }
+
+    // The payload needs to be the padded tail of the frame, as laid out by sendTransaction
+    size_t offset = txn->data()->Data() - head;
+    if (offset > headSize) {
+        return 0;
+    }
+    size_t payloadSize = txn->data()->size();
+    if (offset + payloadSize > size || size - offset - payloadSize >= 8) {
+        return 0;
+    }
+
+    dest = readSink(txn->initiator(), txn->id(), payloadSize);
+    if (!dest) {
+        return 0;
+    }
+    destSize = payloadSize;
+    directPayload = dest;
+    return offset;
+}
+
+int RouterClient::sendMessage(const uint8_t *buffer, size_t size, bool flush) {
+    iovec iov = {const_cast<uint8_t *>(buffer), size};
+    return sendMessage(&iov, 1, flush);
+}
+
+int RouterClient::sendMessage(const iovec *iov, int iovcnt, bool flush) {
+    if (shm) {
+        return shm->tx().write(iov, iovcnt);
+    }
+
+    if (uringWriter) {
+        if (uringWriter->add(iov, iovcnt) == -1) {
+            return -1;
+        }
+        return flush ? uringWriter->flush() : 0;
+    }
+
+    if (frameWriter.add(iov, iovcnt) == -1) {
+        return -1;
+    }
+    return flush ? frameWriter.flush() : 0;
+}
+
+int RouterClient::receiveMessage(std::vector<uint8_t> &buffer) {
+    if (shm) {
+        return shm->rx().read(buffer);
+    }
+    if (uringReader) {
+        return uringReader->read(buffer);
+    }
+    return frameReader.read(buffer);
+}
+
+const uint8_t *RouterClient::receiveFrame() {
+    if (shm) {
+        size_t size = 0;
+        shm->rx().release();
+        return shm->rx().peek(size);
+    }
+
+    size_t size = 0;
+    if (uringReader) {
+        return uringReader->next(size);
+    }
+    directPayload = nullptr;
+    return frameReader.next(size, readSplitter);
+}
+
 void RouterClient::disconnect() {
     if (sock == -1) {
         return;
     }
 
+    // The rings are only marked as closed; the memory stays mapped until the next connect or the destruction of the
+    // client because the other thread of the bridge may still be blocked on them
+    if (shm) {
+        shm->close();
+    }
+
+    // Same goes for the io_uring instances; shutting the socket down completes the receive that is still armed
+    shutdown(sock, SHUT_RDWR);
     close(sock);
     state = State::DISCONNECTED;
     connectedUri = "";
     sock = -1;
+    frameWriter.reset(-1);
+    frameReader.reset(-1);
 }
 
 }  // namespace sw_axi
@@ -20,14 +20,153 @@
 #pragma once
 
 #include "Data.hh"
+#include "Placement.hh"
+#include "ShmRing.hh"
+#include "Uring.hh"
+#include "Utils.hh"
 
 #include <cstdint>
+#include <functional>
+#include <memory>
 #include <utility>
+#include <vector>
 
 namespace sw_axi {
 
+namespace wire {
+struct Message;
+struct Transaction;
+}
+
+/**
+ * A read-only view of a transaction received from the router
+ *
+ * The view points directly into the receive buffer of the client, so neither the transaction nor its payload is
+ * copied. It stays valid until the next transaction is received.
+ */
+class TransactionView {
+    friend class RouterClient;
+
+public:
+    TransactionType getType() const {
+        return type;
+    }
+    uint64_t getInitiator() const;
+    uint64_t getTarget() const;
+    uint64_t getId() const;
+    uint64_t getAddress() const;
+    uint64_t getSize() const;
+    uint8_t getQos() const;
+    uint16_t getBurstLength() const;
+    uint8_t getBurstSize() const;
+    BurstType getBurst() const;
+    uint32_t getAxiId() const;
+
+    /**
+     * Tell whether the transaction is a posted write request or the answer to one that has failed
+     */
+    bool isPosted() const;
+    bool isOk() const;
+    std::string getMessage() const;
+
+    /**
+     * Payload of the transaction; null if there is none
+     */
+    const uint8_t *getData() const;
+
+    /**
+     * Size of the payload in bytes
+     */
+    size_t getDataSize() const;
+
+    /**
+     * WSTRB of a write request, one bit per byte of the payload, LSB first; null if all the bytes are written
+     */
+    const uint8_t *getStrobe() const;
+
+    /**
+     * Size of the WSTRB in bytes, as received
+     */
+    size_t getStrobeSize() const;
+
+    /**
+     * Copy the viewed transaction into a self-contained one
+     */
+    void copyTo(Transaction &txn) const;
+
+private:
+    const void *txn = nullptr;  //!< The underlying wire::Transaction
+    const uint8_t *payload = nullptr;  //!< Where the payload has been received or decoded if not in the buffer
+    size_t payloadSize = 0;  //!< Size of the payload pointed to by the field above
+    TransactionType type = TransactionType::READ_REQ;
+};
+
+/**
+ * A read-only view of the AXI4-Stream traffic received from the router: either a chunk of stream data or the
+ * credits returned to a stream master
+ *
+ * Like TransactionView, it points directly into the receive buffer and stays valid until the next message is
+ * received.
+ */
+class StreamView {
+    friend class RouterClient;
+
+public:
+    /**
+     * Tell whether the message returns credits to the stream master given by getInitiator rather than carry data
+     */
+    bool isCredit() const;
+    uint64_t getInitiator() const;
+    uint64_t getTarget() const;
+    uint64_t getAddress() const;
+    const uint8_t *getData() const;
+    size_t getDataSize() const;
+
+    /**
+     * TKEEP, one bit per byte of the data, LSB first; null if all the bytes are kept
+     */
+    const uint8_t *getKeep() const;
+    uint64_t getUser() const;
+    bool isLast() const;
+
+    /**
+     * Tell whether more chunks of the same piece of data follow
+     */
+    bool hasMore() const;
+    uint32_t getCredits() const;
+
+private:
+    const wire::Message *msg = nullptr;
+};
+
 class RouterClient {
 public:
+    /**
+     * Tells where the payload of a read response should be received; gets the initiator and the ID of the response
+     * and the size of the payload; returns a buffer that can hold the payload or null
+     */
+    typedef std::function<uint8_t *(uint64_t initiator, uint64_t id, size_t size)> ReadSink;
+
+    /**
+     * Gets the stream traffic received in between the transactions; an error status aborts the reception
+     */
+    typedef std::function<Status(const StreamView &view)> StreamHandler;
+
+    /**
+     * Gets the interrupts received in between the transactions together with the number of raises coalesced into
+     * each of them; an error status aborts the reception
+     */
+    typedef std::function<Status(uint32_t number, uint32_t raises)> InterruptHandler;
+
+    /**
+     * Gets the fences received in between the transactions: the FENCE_REQ of a master whose posted writes the
+     * client has been handling, or the FENCE_RESP to a fence of one of its masters; an error status aborts the
+     * reception
+     */
+    typedef std::function<Status(uint64_t master, bool response)> FenceHandler;
+
+    ~RouterClient();
+
     /**
      * Valid states of the client
      */
@@ -48,8 +187,9 @@ public:
     /**
      * Connect to the SystemVerilog simulator
      *
-     * @param uri  an URI pointing to a rendez-vous point with the simulator; currently only UNIX domain sockets are
-     *             supported
+     * @param uri  an URI pointing to a rendez-vous point with the simulator; `unix://path` talks to the router over
+     *             a UNIX domain socket, `shm://path` uses the socket only for the rendez-vous and exchanges all the
+     *             subsequent messages through a pair of shared memory rings
      * @param name name of the client
      *
      * @return     a system info-status pair; the system info pointer is null on failure; the user is responsible
@@ -57,12 +197,51 @@ public:
      */
     std::pair<SystemInfo *, Status> connect(const std::string &uri, const std::string &name);
 
+    /**
+     * Have the client spin for the given number of microseconds whenever it waits for the transport, before it
+     * sleeps in the kernel; the socket is switched to non-blocking mode so that the reads can be retried. It trades
+     * CPU time for latency and only takes effect on the next connect. 0, the default, disables busy polling.
+     */
+    void setBusyPoll(unsigned micros) {
+        busyPollMicros = micros;
+    }
+
+    /**
+     * Announce the number of stripes the client is going to use, this connection included, at the next connect;
+     * with split channels, each stripe is made of a connection for the reads and another one for the writes. The
+     * additional connections have to be attached with `attach` once the client has started. Only the unix://
+     * transport supports more than one connection.
+     */
+    void setStripes(uint32_t count, bool splitChannels = false) {
+        stripes = count ? count : 1;
+        this->splitChannels = splitChannels;
+    }
+
+    /**
+     * Open an additional data connection of the started control client; connection n carries the traffic of the
+     * IP blocks whose ID modulo the number of stripes is equal to n. With split channels, connection n only
+     * carries the reads and connection stripes + n the writes. The connections have to be attached in order,
+     * starting with 1, before the traffic starts.
+     *
+     * The attached client only sends and receives transactions; everything else goes through the control client.
+     */
+    Status attach(const RouterClient &control, uint32_t index);
+
+    /**
+     * Move the buffers receiving the messages to the NUMA node of the calling thread; to be called by the thread
+     * that receives the transactions once it has been pinned
+     */
+    void bindToLocalNode();
+
     /**
      * Register an IP block with the given parameters
      *
+     * @param credits if not null, receives the number of transactions the IP may have in flight, as granted by
+     *                the router; 0 means that there is no limit
+     *
      * @return a slave id-status pair; the ID is invalid if the status indicates failure
      */
-    std::pair<uint64_t, Status> registerIp(const IpConfig &config);
+    std::pair<uint64_t, Status> registerIp(const IpConfig &config, uint32_t *credits = nullptr);
 
     /**
      * Confirm that all IP has been registered.
@@ -97,17 +276,106 @@ public:
      */
     std::pair<Transaction *, Status> receiveTransaction();
 
+    /**
+     * Retrieves a transaction sent by the router without copying it out of the receive buffer
+     *
+     * An encoded payload is decoded into the buffer supplied by the read sink, for read responses, or into a buffer
+     * of the client that is reused for every transaction.
+     *
+     * @return the status of the operation and a view of the transaction upon success; the view is valid until the
+     *         next transaction is received; if the status code is equal to DONE then no new transaction will arrive
+     */
+    std::pair<TransactionView, Status> receiveTransactionView();
+
+    /**
+     * Have the payloads of large read responses received straight into the buffers supplied by the sink; the view
+     * of such a response then points to the payload in the supplied buffer
+     */
+    void setReadSink(ReadSink sink);
+
+    /**
+     * Have the stream traffic handed over to the handler by `receiveTransactionView`, as it arrives; without a
+     * handler, stream traffic is a protocol error
+     */
+    void setStreamHandler(StreamHandler handler) {
+        streamHandler = std::move(handler);
+    }
+
+    /**
+     * Have the interrupts handed over to the handler by `receiveTransactionView`, as they arrive; without a handler,
+     * an interrupt is a protocol error
+     */
+    void setInterruptHandler(InterruptHandler handler) {
+        interruptHandler = std::move(handler);
+    }
+
+    /**
+     * Have the fences handed over to the handler by `receiveTransactionView`, as they arrive; without a handler, a
+     * fence is a protocol error
+     */
+    void setFenceHandler(FenceHandler handler) {
+        fenceHandler = std::move(handler);
+    }
+
     /**
      * Sends a transaction to the router
+     *
+     * A large payload, or one passed through `Transaction::external`, is not copied into the message but written
+     * to the transport straight from where it lives before the call returns. Payloads with long runs of zeros or
+     * repeated words are run-length encoded if all the peers have announced that they can decode them.
+     *
+     * @param flush if false, the transaction may be held back until the next `flush` call; the transactions held
+     *              back go out together in a single TRANSACTION_BATCH message
      */
-    Status sendTransaction(const Transaction &txn);
+    Status sendTransaction(const Transaction &txn, bool flush = true);
 
     /**
      * Send a master termination notification
      *
-     * @param id id of the master that has been terminated
+     * @param id    id of the master that has been terminated
+     * @param flush if false, the message may be held back until the next `flush` call
+     */
+    Status sendTermination(uint64_t id, bool flush = true);
+
+    /**
+     * Send a chunk of stream data; the payload is written to the transport straight from the memory of the caller
+     * before the call returns
+     *
+     * @param flush if false, the message may be held back until the next `flush` call
      */
-    Status sendTermination(uint64_t id);
+    Status sendStreamChunk(const StreamChunk &chunk, bool flush = true);
+
+    /**
+     * Give stream credits back to a stream master once the chunks it has sent have been consumed
+     *
+     * @param master  id of the stream master
+     * @param credits number of chunks consumed
+     * @param flush   if false, the message may be held back until the next `flush` call
+     */
+    Status sendStreamCredit(uint64_t master, uint32_t credits, bool flush = true);
+
+    /**
+     * Raise an interrupt; the router delivers it to all the other clients
+     *
+     * @param number the interrupt line, within the range allocated to one of the IP blocks of the client
+     * @param flush  if false, the message may be held back until the next `flush` call
+     */
+    Status sendInterrupt(uint32_t number, bool flush = true);
+
+    /**
+     * Send the FENCE_REQ of a master, which the router passes on to the clients handling its posted writes, or the
+     * FENCE_RESP of such a client once it has handled the posted writes received before the request
+     *
+     * @param master   id of the fencing master
+     * @param response whether to send a FENCE_RESP rather than a FENCE_REQ
+     * @param flush    if false, the message may be held back until the next `flush` call
+     */
+    Status sendFence(uint64_t master, bool response, bool flush = true);
+
+    /**
+     * Write out all the messages that have been held back
+     */
+    Status flush();
 
     /**
      * Send a logout message
@@ -129,9 +397,73 @@ public:
     }
 
 private:
+    static const size_t MAX_BATCH_LENGTH = 256;  //!< Maximum number of transactions in a batch
+    static const size_t MAX_BATCH_BYTES = 64 * 1024;  //!< A batch is sent out once it grows larger than this
+    static const size_t TAIL_PAYLOAD_THRESHOLD = 16 * 1024;  //!< Larger payloads are not copied into the message
+    static const size_t ENCODE_THRESHOLD = 256;  //!< Smaller payloads are always sent raw
+
+    /**
+     * Wrap the transactions held back so far in a message and send it
+     *
+     * @return 0 on success; -1 on failure
+     */
+    int sendBatch(bool flush);
+
+    /**
+     * Pre-serialize a TRANSACTION message with all the header fields present and no payload
+     */
+    void buildTxnTemplate();
+
+    size_t splitReadResponse(const uint8_t *head, size_t headSize, size_t size, uint8_t *&dest, size_t &destSize);
+
+    /**
+     * Connect the socket to the router listening at path
+     */
+    Status openSocket(const std::string &path);
+
+    /**
+     * Prepare the framing of the messages and the transport specific options once the connection is established
+     */
+    Status setUpTransport();
+
+    int sendMessage(const uint8_t *buffer, size_t size, bool flush = true);
+    int sendMessage(const iovec *iov, int iovcnt, bool flush = true);
+    int receiveMessage(std::vector<uint8_t> &buffer);
+
+    /**
+     * Receive a message without copying it out of the shared memory ring or the read buffer. The frame stays valid
+     * until the next call.
+     *
+     * @return a pointer to the message or null on failure
+     */
+    const uint8_t *receiveFrame();
+
     State state = State::DISCONNECTED;
     std::string connectedUri;
     int sock = -1;
+    std::unique_ptr<ShmChannel> shm;
+    FrameWriter frameWriter;
+    FrameReader frameReader;
+    std::unique_ptr<UringFrameWriter> uringWriter;  //!< Used instead of the frame writer if io_uring is available
+    std::unique_ptr<UringFrameReader> uringReader;  //!< Used instead of the frame reader if io_uring is available
+    flatbuffers::FlatBufferBuilder batchBuilder;  //!< Holds the transactions that have not been sent yet
+    std::vector<uint8_t> txnTemplate;  //!< Message patched in place for transactions without payload
+    std::vector<flatbuffers::Offset<wire::Transaction>> batch;
+    const void *rxBatch = nullptr;  //!< Transactions of the TRANSACTION_BATCH message being received
+    size_t rxBatchPos = 0;  //!< Index of the next transaction to hand out from the received batch
+    ReadSink readSink;
+    StreamHandler streamHandler;
+    InterruptHandler interruptHandler;
+    FenceHandler fenceHandler;
+    FrameReader::TailSplitter readSplitter;
+    uint8_t *directPayload = nullptr;  //!< Where the payload of the last frame has been received, if elsewhere
+    unsigned busyPollMicros = 0;
+    uint32_t stripes = 1;  //!< Number of stripes announced to the router
+    bool splitChannels = false;  //!< Whether the reads and the writes of each stripe have connections of their own
+    uint64_t clientId = 0;  //!< ID of the client assigned by the router
+    uint32_t encodings = 0;  //!< Bit mask of the payload encodings that every peer can decode
+    std::vector<uint8_t> encodeBuffer;
+    std::vector<uint8_t> decodeBuffer;
 };
 
 }  // namespace sw_axi
@@ -0,0 +1,330 @@
+//------------------------------------------------------------------------------
+// Copyright (C) 2020 Daedalean AG
+//
+// This file is part of SW-AXI.
+//
+// SW-AXI is free software: you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+//
+// SW-AXI is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with SW-AXI.  If not, see <https://www.gnu.org/licenses/>.
+//------------------------------------------------------------------------------
+
+#include "ShmRing.hh"
+#include "Utils.hh"
+
+#include <algorithm>
+#include <cerrno>
+#include <chrono>
+#include <climits>
+#include <cstring>
+#include <linux/futex.h>
+#include <poll.h>
+#include <string>
+#include <sys/mman.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+
+#ifndef MFD_CLOEXEC
+#define MFD_CLOEXEC 0x0001U
+#endif
+
+namespace sw_axi {
+
+namespace {
+const uint64_t CONTINUED = 1ULL << 63;
+const uint64_t WRAP = ~0ULL;
+const int SPIN_COUNT = 256;
+const long WAIT_TIMEOUT_NS = 50 * 1000 * 1000;
+
+uint64_t align8(uint64_t size) {
+    return (size + 7) & ~7ULL;
+}
+
+void futexWait(uint32_t *addr, uint32_t val) {
+    timespec ts = {0, WAIT_TIMEOUT_NS};
+    syscall(SYS_futex, addr, FUTEX_WAIT, val, &ts, nullptr, 0);
+}
+
+void futexWake(uint32_t *addr) {
+    syscall(SYS_futex, addr, FUTEX_WAKE, INT_MAX, nullptr, nullptr, 0);
+}
+}  // namespace
+
+ShmRing::ShmRing(uint8_t *base) : base(base), data(base + HEADER_SIZE) {
+    capacity = __atomic_load_n(reinterpret_cast<uint64_t *>(base + 0x108), __ATOMIC_ACQUIRE);
+}
+
+void ShmRing::init(uint64_t capacity) {
+    memset(base, 0, HEADER_SIZE);
+    this->capacity = capacity;
+    __atomic_store_n(reinterpret_cast<uint64_t *>(base + 0x108), capacity, __ATOMIC_RELEASE);
+}
+
+bool ShmRing::isClosed() const {
+    return __atomic_load_n(closed(), __ATOMIC_ACQUIRE) != 0;
+}
+
+bool ShmRing::hasData() const {
+    return __atomic_load_n(head(), __ATOMIC_SEQ_CST) != __atomic_load_n(tail(), __ATOMIC_RELAXED);
+}
+
+bool ShmRing::hasSpace() const {
+    uint64_t used = __atomic_load_n(head(), __ATOMIC_RELAXED) - __atomic_load_n(tail(), __ATOMIC_SEQ_CST);
+    return capacity - used >= needed;
+}
+
+bool ShmRing::waitFor(uint32_t *seq, uint32_t *waiting, bool (ShmRing::*ready)() const) {
+    for (int i = 0; i < SPIN_COUNT; ++i) {
+        if ((this->*ready)()) {
+            return true;
+        }
+        cpuRelax();
+    }
+
+    if (busyPollMicros) {
+        auto deadline = std::chrono::steady_clock::now() + std::chrono::microseconds(busyPollMicros);
+        while (!isClosed() && std::chrono::steady_clock::now() < deadline) {
+            if ((this->*ready)()) {
+                return true;
+            }
+            cpuRelax();
+        }
+    }
+
+    while (true) {
+        uint32_t s = __atomic_load_n(seq, __ATOMIC_SEQ_CST);
+        __atomic_store_n(waiting, 1, __ATOMIC_SEQ_CST);
+        if ((this->*ready)()) {
+            __atomic_store_n(waiting, 0, __ATOMIC_SEQ_CST);
+            return true;
+        }
+
+        if (isClosed()) {
+            __atomic_store_n(waiting, 0, __ATOMIC_SEQ_CST);
+            errno = EPIPE;
+            return false;
+        }
+
+        futexWait(seq, s);
+        __atomic_store_n(waiting, 0, __ATOMIC_SEQ_CST);
+
+        if ((this->*ready)()) {
+            return true;
+        }
+
+        if (livenessSocket != -1) {
+            pollfd pfd = {livenessSocket, POLLRDHUP, 0};
+            if (poll(&pfd, 1, 0) == 1 && (pfd.revents & (POLLRDHUP | POLLHUP | POLLERR))) {
+                close();
+            }
+        }
+    }
+}
+
+void ShmRing::wake(uint32_t *seq, uint32_t *waiting) {
+    __atomic_fetch_add(seq, 1, __ATOMIC_SEQ_CST);
+    if (__atomic_load_n(waiting, __ATOMIC_SEQ_CST)) {
+        futexWake(seq);
+    }
+}
+
+int ShmRing::write(const iovec *iov, int iovcnt) {
+    uint64_t remaining = 0;
+    for (int i = 0; i < iovcnt; ++i) {
+        remaining += iov[i].iov_len;
+    }
+
+    const uint64_t maxChunk = ((capacity / 4) & ~7ULL) - 8;
+    int seg = 0;
+    size_t segOffset = 0;
+
+    do {
+        if (isClosed()) {
+            errno = EPIPE;
+            return -1;
+        }
+
+        uint64_t chunk = std::min(remaining, maxChunk);
+        uint64_t recordSize = 8 + align8(chunk);
+        uint64_t h = __atomic_load_n(head(), __ATOMIC_RELAXED);
+        uint64_t pos = h & (capacity - 1);
+        uint64_t skip = (capacity - pos < recordSize) ? capacity - pos : 0;
+
+        needed = skip + recordSize;
+        if (!waitFor(spaceSeq(), spaceWaiting(), &ShmRing::hasSpace)) {
+            return -1;
+        }
+
+        if (skip) {
+            memcpy(data + pos, &WRAP, sizeof(WRAP));
+            pos = 0;
+        }
+
+        remaining -= chunk;
+        uint64_t header = chunk | (remaining ? CONTINUED : 0);
+        memcpy(data + pos, &header, sizeof(header));
+
+        uint8_t *dst = data + pos + 8;
+        while (chunk) {
+            size_t len = std::min<size_t>(chunk, iov[seg].iov_len - segOffset);
+            memcpy(dst, static_cast<const uint8_t *>(iov[seg].iov_base) + segOffset, len);
+            dst += len;
+            chunk -= len;
+            segOffset += len;
+            if (segOffset == iov[seg].iov_len) {
+                ++seg;
+                segOffset = 0;
+            }
+        }
+
+        __atomic_store_n(head(), h + skip + recordSize, __ATOMIC_SEQ_CST);
+        wake(dataSeq(), dataWaiting());
+    } while (remaining);
+
+    return 0;
+}
+
+int ShmRing::write(const uint8_t *buffer, size_t size) {
+    iovec iov = {const_cast<uint8_t *>(buffer), size};
+    return write(&iov, 1);
+}
+
+bool ShmRing::nextRecord(uint64_t &header) {
+    while (true) {
+        if (!waitFor(dataSeq(), dataWaiting(), &ShmRing::hasData)) {
+            return false;
+        }
+
+        uint64_t t = __atomic_load_n(tail(), __ATOMIC_RELAXED);
+        uint64_t pos = t & (capacity - 1);
+        memcpy(&header, data + pos, sizeof(header));
+        if (header != WRAP) {
+            return true;
+        }
+
+        __atomic_store_n(tail(), t + (capacity - pos), __ATOMIC_SEQ_CST);
+        wake(spaceSeq(), spaceWaiting());
+    }
+}
+
+const uint8_t *ShmRing::peek(size_t &size) {
+    uint64_t header;
+    if (!nextRecord(header)) {
+        return nullptr;
+    }
+
+    uint64_t t = __atomic_load_n(tail(), __ATOMIC_RELAXED);
+    uint8_t *record = data + (t & (capacity - 1));
+
+    if (!(header & CONTINUED)) {
+        size = header;
+        peeked = 8 + align8(header);
+        return record + 8;
+    }
+
+    assembled.clear();
+    while (true) {
+        uint64_t len = header & ~CONTINUED;
+        assembled.insert(assembled.end(), record + 8, record + 8 + len);
+        __atomic_store_n(tail(), t + 8 + align8(len), __ATOMIC_SEQ_CST);
+        wake(spaceSeq(), spaceWaiting());
+
+        if (!(header & CONTINUED)) {
+            break;
+        }
+
+        if (!nextRecord(header)) {
+            return nullptr;
+        }
+        t = __atomic_load_n(tail(), __ATOMIC_RELAXED);
+        record = data + (t & (capacity - 1));
+    }
+
+    peeked = 0;
+    size = assembled.size();
+    return assembled.data();
+}
+
+void ShmRing::release() {
+    if (!peeked) {
+        return;
+    }
+    uint64_t t = __atomic_load_n(tail(), __ATOMIC_RELAXED);
+    __atomic_store_n(tail(), t + peeked, __ATOMIC_SEQ_CST);
+    peeked = 0;
+    wake(spaceSeq(), spaceWaiting());
+}
+
+int ShmRing::read(std::vector<uint8_t> &buffer) {
+    size_t size = 0;
+    const uint8_t *msg = peek(size);
+    if (!msg) {
+        return -1;
+    }
+    buffer.assign(msg, msg + size);
+    release();
+    return 0;
+}
+
+void ShmRing::close() {
+    if (!base) {
+        return;
+    }
+    __atomic_store_n(closed(), 1, __ATOMIC_SEQ_CST);
+    wake(dataSeq(), dataWaiting());
+    wake(spaceSeq(), spaceWaiting());
+}
+
+ShmChannel::~ShmChannel() {
+    close();
+    if (mem) {
+        munmap(mem, memSize);
+    }
+    if (fd != -1) {
+        ::close(fd);
+    }
+}
+
+Status ShmChannel::create(uint64_t capacity) {
+    if (capacity < 4096 || (capacity & (capacity - 1))) {
+        return Status(1, "The shared memory ring capacity needs to be a power of two of at least 4096 bytes");
+    }
+
+    fd = syscall(SYS_memfd_create, "sw-axi", MFD_CLOEXEC);
+    if (fd == -1) {
+        return Status(1, std::string("Unable to create the shared memory segment: ") + strerror(errno));
+    }
+
+    memSize = 2 * ShmRing::requiredSize(capacity);
+    if (ftruncate(fd, memSize) == -1) {
+        return Status(1, std::string("Unable to size the shared memory segment: ") + strerror(errno));
+    }
+
+    void *ptr = mmap(nullptr, memSize, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+    if (ptr == MAP_FAILED) {
+        return Status(1, std::string("Unable to map the shared memory segment: ") + strerror(errno));
+    }
+
+    mem = static_cast<uint8_t *>(ptr);
+    txRing = ShmRing(mem);
+    txRing.init(capacity);
+    rxRing = ShmRing(mem + ShmRing::requiredSize(capacity));
+    rxRing.init(capacity);
+    this->capacity = capacity;
+    return Status();
+}
+
+void ShmChannel::close() {
+    txRing.close();
+    rxRing.close();
+}
+
+}  // namespace sw_axi
@@ -0,0 +1,231 @@
+//------------------------------------------------------------------------------
+// Copyright (C) 2020 Daedalean AG
+//
+// This file is part of SW-AXI.
+//
+// SW-AXI is free software: you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+//
+// SW-AXI is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with SW-AXI.  If not, see <https://www.gnu.org/licenses/>.
+//------------------------------------------------------------------------------
+
+#pragma once
+
+#include "Data.hh"
+
+#include <cstddef>
+#include <cstdint>
+#include <sys/uio.h>
+#include <vector>
+
+namespace sw_axi {
+
+/**
+ * A single-producer single-consumer ring of variable size messages living in shared memory
+ *
+ * The layout of the ring is shared with the router and must not change without updating `shm.go`:
+ *
+ *   0x000 head            - uint64, bytes published by the producer
+ *   0x040 tail            - uint64, bytes released by the consumer
+ *   0x080 dataSeq         - uint32, futex word bumped by the producer on every publish
+ *   0x084 dataWaiting     - uint32, non-zero when the consumer sleeps on dataSeq
+ *   0x0c0 spaceSeq        - uint32, futex word bumped by the consumer on every release
+ *   0x0c4 spaceWaiting    - uint32, non-zero when the producer sleeps on spaceSeq
+ *   0x100 closed          - uint32, non-zero when either side has gone away
+ *   0x108 capacity        - uint64, size of the data area; a power of two
+ *   0x140 data
+ *
+ * Each record in the data area is an 8-byte little endian header followed by the payload padded to 8 bytes. The
+ * most significant bit of the header indicates that the message continues in the next record; a header of all ones
+ * tells the consumer to skip to the beginning of the data area. Records never wrap around, so the consumer can
+ * always access the payload of a record in place.
+ */
+class ShmRing {
+public:
+    static const size_t HEADER_SIZE = 0x140;
+
+    ShmRing() {}
+
+    /**
+     * Attach to the ring located at the given memory address
+     */
+    explicit ShmRing(uint8_t *base);
+
+    /**
+     * Initialize the header of a fresh ring; must be called by the creator before the memory is shared
+     */
+    void init(uint64_t capacity);
+
+    /**
+     * Size of the memory area required to hold a ring of the given capacity
+     */
+    static size_t requiredSize(uint64_t capacity) {
+        return HEADER_SIZE + capacity;
+    }
+
+    /**
+     * Publish a message gathered from the given segments; wait for the consumer to make space if necessary
+     *
+     * @return 0 on success; -1 if the ring has been closed
+     */
+    int write(const iovec *iov, int iovcnt);
+
+    /**
+     * Publish a message; wait for the consumer to make space if necessary
+     *
+     * @return 0 on success; -1 if the ring has been closed
+     */
+    int write(const uint8_t *buffer, size_t size);
+
+    /**
+     * Wait for the next message and make it accessible without copying it out of the ring. Messages spanning
+     * multiple records are assembled in a private buffer. The pointer stays valid until `release` is called.
+     *
+     * @return a pointer to the message or null if the ring has been closed
+     */
+    const uint8_t *peek(size_t &size);
+
+    /**
+     * Give the space occupied by the message returned by the last `peek` back to the producer
+     */
+    void release();
+
+    /**
+     * Receive the next message and copy it to the buffer vector
+     *
+     * @return 0 on success; -1 if the ring has been closed
+     */
+    int read(std::vector<uint8_t> &buffer);
+
+    /**
+     * Mark the ring as closed and wake up both sides
+     */
+    void close();
+
+    /**
+     * Check whether the peer is still there when a wait times out; the check gets the socket descriptor that was
+     * used for the rendez-vous with the peer
+     */
+    void setLivenessSocket(int sock) {
+        livenessSocket = sock;
+    }
+
+    /**
+     * Keep spinning for the given number of microseconds before sleeping on the futex whenever this side has to
+     * wait for the peer; 0 only spins briefly
+     */
+    void setBusyPoll(unsigned micros) {
+        busyPollMicros = micros;
+    }
+
+private:
+    uint64_t *head() const {
+        return reinterpret_cast<uint64_t *>(base);
+    }
+    uint64_t *tail() const {
+        return reinterpret_cast<uint64_t *>(base + 0x40);
+    }
+    uint32_t *dataSeq() const {
+        return reinterpret_cast<uint32_t *>(base + 0x80);
+    }
+    uint32_t *dataWaiting() const {
+        return reinterpret_cast<uint32_t *>(base + 0x84);
+    }
+    uint32_t *spaceSeq() const {
+        return reinterpret_cast<uint32_t *>(base + 0xc0);
+    }
+    uint32_t *spaceWaiting() const {
+        return reinterpret_cast<uint32_t *>(base + 0xc4);
+    }
+    uint32_t *closed() const {
+        return reinterpret_cast<uint32_t *>(base + 0x100);
+    }
+
+    bool isClosed() const;
+    bool waitFor(uint32_t *seq, uint32_t *waiting, bool (ShmRing::*ready)() const);
+    void wake(uint32_t *seq, uint32_t *waiting);
+    bool hasData() const;
+    bool hasSpace() const;
+    bool nextRecord(uint64_t &header);
+
+    uint8_t *base = nullptr;
+    uint8_t *data = nullptr;
+    uint64_t capacity = 0;
+    uint64_t needed = 0;  //!< Space the producer is waiting for
+    uint64_t peeked = 0;  //!< Length of the record returned by the last in-place peek
+    std::vector<uint8_t> assembled;  //!< Buffer for messages spanning multiple records
+    int livenessSocket = -1;
+    unsigned busyPollMicros = 0;
+};
+
+/**
+ * A pair of rings in a memfd segment shared with the router
+ */
+class ShmChannel {
+public:
+    ShmChannel() {}
+    ~ShmChannel();
+    ShmChannel(const ShmChannel &) = delete;
+    ShmChannel &operator=(const ShmChannel &) = delete;
+
+    /**
+     * Default capacity of each direction of the channel
+     */
+    static const uint64_t DEFAULT_CAPACITY = 16 * 1024 * 1024;
+
+    /**
+     * Create the shared memory segment and initialize both rings
+     */
+    Status create(uint64_t capacity = DEFAULT_CAPACITY);
+
+    /**
+     * File descriptor of the memory segment; to be passed to the router
+     */
+    int getFd() const {
+        return fd;
+    }
+
+    /**
+     * Size of each of the rings
+     */
+    uint64_t getCapacity() const {
+        return capacity;
+    }
+
+    /**
+     * The ring carrying messages to the router
+     */
+    ShmRing &tx() {
+        return txRing;
+    }
+
+    /**
+     * The ring carrying messages from the router
+     */
+    ShmRing &rx() {
+        return rxRing;
+    }
+
+    /**
+     * Close both rings and unmap the memory
+     */
+    void close();
+
+private:
+    int fd = -1;
+    uint8_t *mem = nullptr;
+    size_t memSize = 0;
+    uint64_t capacity = 0;
+    ShmRing txRing;
+    ShmRing rxRing;
+};
+
+}  // namespace sw_axi
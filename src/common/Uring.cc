@@ -0,0 +1,430 @@
+//------------------------------------------------------------------------------
+// Copyright (C) 2020 Daedalean AG
+//
+// This file is part of SW-AXI.
+//
+// SW-AXI is free software: you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+//
+// SW-AXI is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with SW-AXI.  If not, see <https://www.gnu.org/licenses/>.
+//------------------------------------------------------------------------------
+
+#include "Uring.hh"
+#include "Placement.hh"
+#include "Utils.hh"
+
+#include <algorithm>
+#include <cerrno>
+#include <cstring>
+
+#ifdef SW_AXI_IO_URING
+#include <liburing.h>
+#include <sys/socket.h>
+#endif
+
+namespace sw_axi {
+
+#ifdef SW_AXI_IO_URING
+
+struct UringFrameWriter::State {
+    io_uring ring;
+    std::vector<uint8_t> staging;
+};
+
+struct UringFrameReader::State {
+    io_uring ring;
+    io_uring_buf_ring *bufRing = nullptr;
+    std::vector<uint8_t> buffers;
+    bool armed = false;
+};
+
+namespace {
+const int BUFFER_GROUP = 0;
+}  // namespace
+
+bool UringFrameWriter::isAvailable() {
+    return true;
+}
+
+UringFrameWriter::~UringFrameWriter() {
+    if (state) {
+        io_uring_queue_exit(&state->ring);
+        delete state;
+    }
+}
+
+int UringFrameWriter::init(int sock) {
+    State *st = new State();
+    if (io_uring_queue_init(QUEUE_DEPTH, &st->ring, 0) < 0) {
+        delete st;
+        return -1;
+    }
+
+    st->staging.resize(STAGING_SIZE);
+    iovec iov = {st->staging.data(), st->staging.size()};
+    if (io_uring_register_buffers(&st->ring, &iov, 1) < 0) {
+        io_uring_queue_exit(&st->ring);
+        delete st;
+        return -1;
+    }
+
+    state = st;
+    this->sock = sock;
+    segments.clear();
+    staged = 0;
+    return 0;
+}
+
+int UringFrameWriter::stage(const void *data, size_t size) {
+    if (staged + size > STAGING_SIZE && flush() == -1) {
+        return -1;
+    }
+
+    // Consecutive small frames form a single send
+    if (segments.empty() || segments.back().external) {
+        segments.push_back(Segment{nullptr, staged, 0});
+    }
+    memcpy(state->staging.data() + staged, data, size);
+    staged += size;
+    segments.back().size += size;
+    return 0;
+}
+
+int UringFrameWriter::add(const uint8_t *buffer, size_t size) {
+    iovec iov = {const_cast<uint8_t *>(buffer), size};
+    return add(&iov, 1);
+}
+
+int UringFrameWriter::add(const iovec *iov, int iovcnt) {
+    uint64_t sz = 0;
+    for (int i = 0; i < iovcnt; ++i) {
+        sz += iov[i].iov_len;
+    }
+    if (stage(&sz, sizeof(sz)) == -1) {
+        return -1;
+    }
+
+    bool direct = false;
+    for (int i = 0; i < iovcnt; ++i) {
+        const uint8_t *base = static_cast<const uint8_t *>(iov[i].iov_base);
+        if (iov[i].iov_len >= DIRECT_THRESHOLD) {
+            segments.push_back(Segment{base, 0, iov[i].iov_len});
+            direct = true;
+        } else if (iov[i].iov_len && stage(base, iov[i].iov_len) == -1) {
+            return -1;
+        }
+    }
+    return direct ? flush() : 0;
+}
+
+int UringFrameWriter::flush() {
+    if (segments.empty()) {
+        return 0;
+    }
+
+    size_t offset = 0;
+    int ret = 0;
+    while (offset < segments.size() && !ret) {
+        // Chain as many sends as the submission queue can take; the kernel executes them in order
+        size_t count = std::min<size_t>(segments.size() - offset, QUEUE_DEPTH);
+        for (size_t i = 0; i < count; ++i) {
+            const Segment &seg = segments[offset + i];
+            io_uring_sqe *sqe = io_uring_get_sqe(&state->ring);
+            if (seg.external) {
+                io_uring_prep_send(sqe, sock, seg.external, seg.size, MSG_WAITALL);
+            } else {
+                io_uring_prep_write_fixed(sqe, sock, state->staging.data() + seg.offset, seg.size, 0, 0);
+            }
+            if (i != count - 1) {
+                sqe->flags |= IOSQE_IO_LINK;
+            }
+            io_uring_sqe_set_data(sqe, reinterpret_cast<void *>(offset + i));
+        }
+
+        int submitted;
+        do {
+            submitted = io_uring_submit_and_wait(&state->ring, count);
+        } while (submitted == -EINTR);
+        if (submitted < 0) {
+            errno = -submitted;
+            ret = -1;
+            break;
+        }
+
+        // A short send breaks the chain; the remainder of the chain is written out the old way
+        size_t broken = segments.size();
+        size_t brokenWritten = 0;
+        for (size_t i = 0; i < count; ++i) {
+            io_uring_cqe *cqe;
+            int err;
+            do {
+                err = io_uring_wait_cqe(&state->ring, &cqe);
+            } while (err == -EINTR);
+            if (err < 0) {
+                errno = -err;
+                ret = -1;
+                break;
+            }
+
+            size_t index = reinterpret_cast<size_t>(io_uring_cqe_get_data(cqe));
+            int res = cqe->res;
+            io_uring_cqe_seen(&state->ring, cqe);
+
+            if (res != int(segments[index].size) && index < broken) {
+                broken = index;
+                brokenWritten = res > 0 ? res : 0;
+                if (res < 0 && res != -ECANCELED && res != -EINTR && res != -EAGAIN) {
+                    errno = -res;
+                    ret = -1;
+                }
+            }
+        }
+
+        if (!ret && broken < segments.size()) {
+            std::vector<iovec> iov;
+            for (size_t i = broken; i < segments.size(); ++i) {
+                const Segment &seg = segments[i];
+                const uint8_t *base = seg.external ? seg.external : state->staging.data() + seg.offset;
+                size_t skip = i == broken ? brokenWritten : 0;
+                iov.push_back(iovec{const_cast<uint8_t *>(base) + skip, seg.size - skip});
+            }
+            ret = writeAll(sock, iov.data(), iov.size());
+            break;
+        }
+        offset += count;
+    }
+
+    segments.clear();
+    staged = 0;
+    return ret;
+}
+
+UringFrameReader::~UringFrameReader() {
+    if (state) {
+        if (state->bufRing) {
+            io_uring_free_buf_ring(&state->ring, state->bufRing, NUM_BUFFERS, BUFFER_GROUP);
+        }
+        io_uring_queue_exit(&state->ring);
+        delete state;
+    }
+}
+
+int UringFrameReader::init(int sock) {
+    State *st = new State();
+    if (io_uring_queue_init(QUEUE_DEPTH, &st->ring, 0) < 0) {
+        delete st;
+        return -1;
+    }
+
+    int err = 0;
+    st->bufRing = io_uring_setup_buf_ring(&st->ring, NUM_BUFFERS, BUFFER_GROUP, 0, &err);
+    if (!st->bufRing) {
+        io_uring_queue_exit(&st->ring);
+        delete st;
+        return -1;
+    }
+
+    st->buffers.resize(NUM_BUFFERS * BUFFER_SIZE);
+    for (unsigned i = 0; i < NUM_BUFFERS; ++i) {
+        io_uring_buf_ring_add(
+                st->bufRing,
+                st->buffers.data() + i * BUFFER_SIZE,
+                BUFFER_SIZE,
+                i,
+                io_uring_buf_ring_mask(NUM_BUFFERS),
+                i);
+    }
+    io_uring_buf_ring_advance(st->bufRing, NUM_BUFFERS);
+
+    state = st;
+    this->sock = sock;
+    chunk = nullptr;
+    chunkSize = 0;
+    chunkPos = 0;
+    assembly.clear();
+    return 0;
+}
+
+void UringFrameReader::recycle() {
+    if (!chunk) {
+        return;
+    }
+    io_uring_buf_ring_add(
+            state->bufRing,
+            state->buffers.data() + chunkId * BUFFER_SIZE,
+            BUFFER_SIZE,
+            chunkId,
+            io_uring_buf_ring_mask(NUM_BUFFERS),
+            0);
+    io_uring_buf_ring_advance(state->bufRing, 1);
+    chunk = nullptr;
+}
+
+bool UringFrameReader::nextChunk() {
+    while (true) {
+        if (!state->armed) {
+            io_uring_sqe *sqe = io_uring_get_sqe(&state->ring);
+            io_uring_prep_recv_multishot(sqe, sock, nullptr, 0, 0);
+            sqe->flags |= IOSQE_BUFFER_SELECT;
+            sqe->buf_group = BUFFER_GROUP;
+            int ret = io_uring_submit(&state->ring);
+            if (ret < 0) {
+                errno = -ret;
+                return false;
+            }
+            state->armed = true;
+        }
+
+        io_uring_cqe *cqe;
+        int err;
+        do {
+            err = io_uring_wait_cqe(&state->ring, &cqe);
+        } while (err == -EINTR);
+        if (err < 0) {
+            errno = -err;
+            return false;
+        }
+
+        int res = cqe->res;
+        unsigned flags = cqe->flags;
+        io_uring_cqe_seen(&state->ring, cqe);
+
+        // The kernel stops the multishot receive when it runs out of buffers or hits an error
+        if (!(flags & IORING_CQE_F_MORE)) {
+            state->armed = false;
+        }
+
+        if (res == -ENOBUFS) {
+            continue;
+        }
+        if (res <= 0) {
+            errno = res ? -res : EPIPE;
+            return false;
+        }
+
+        chunkId = flags >> IORING_CQE_BUFFER_SHIFT;
+        chunk = state->buffers.data() + chunkId * BUFFER_SIZE;
+        chunkSize = res;
+        chunkPos = 0;
+        return true;
+    }
+}
+
+const uint8_t *UringFrameReader::next(size_t &size) {
+    if (!state) {
+        return nullptr;
+    }
+
+    while (true) {
+        uint64_t sz;
+        if (assembly.size() >= sizeof(sz)) {
+            memcpy(&sz, assembly.data(), sizeof(sz));
+            if (assembly.size() - sizeof(sz) == sz) {
+                frame.swap(assembly);
+                assembly.clear();
+                size = sz;
+                return frame.data() + sizeof(sz);
+            }
+        }
+
+        if (!chunk || chunkPos == chunkSize) {
+            recycle();
+            if (!nextChunk()) {
+                return nullptr;
+            }
+        }
+
+        size_t available = chunkSize - chunkPos;
+        const uint8_t *ptr = chunk + chunkPos;
+
+        // Hand out the frames contained in a single buffer in place
+        if (assembly.empty()) {
+            if (available >= sizeof(sz)) {
+                memcpy(&sz, ptr, sizeof(sz));
+                if (available - sizeof(sz) >= sz) {
+                    chunkPos += sizeof(sz) + sz;
+                    size = sz;
+                    return ptr + sizeof(sz);
+                }
+            }
+            assembly.assign(ptr, ptr + available);
+            chunkPos = chunkSize;
+            continue;
+        }
+
+        size_t needed = sizeof(sz) + (assembly.size() >= sizeof(sz) ? sz : 0);
+        size_t take = std::min(available, needed - assembly.size());
+        assembly.insert(assembly.end(), ptr, ptr + take);
+        chunkPos += take;
+    }
+}
+
+void UringFrameReader::bindToLocalNode() {
+    if (state) {
+        moveToLocalNode(state->buffers.data(), state->buffers.size());
+    }
+}
+
+#else
+
+bool UringFrameWriter::isAvailable() {
+    return false;
+}
+
+UringFrameWriter::~UringFrameWriter() {}
+
+int UringFrameWriter::init(int) {
+    errno = ENOSYS;
+    return -1;
+}
+
+int UringFrameWriter::add(const uint8_t *, size_t) {
+    errno = ENOSYS;
+    return -1;
+}
+
+int UringFrameWriter::add(const iovec *, int) {
+    errno = ENOSYS;
+    return -1;
+}
+
+int UringFrameWriter::flush() {
+    errno = ENOSYS;
+    return -1;
+}
+
+UringFrameReader::~UringFrameReader() {}
+
+int UringFrameReader::init(int) {
+    errno = ENOSYS;
+    return -1;
+}
+
+const uint8_t *UringFrameReader::next(size_t &) {
+    errno = ENOSYS;
+    return nullptr;
+}
+
+void UringFrameReader::bindToLocalNode() {}
+
+#endif
+
+int UringFrameReader::read(std::vector<uint8_t> &buffer) {
+    size_t size = 0;
+    const uint8_t *frame = next(size);
+    if (!frame) {
+        return -1;
+    }
+    buffer.assign(frame, frame + size);
+    return 0;
+}
+
+}  // namespace sw_axi
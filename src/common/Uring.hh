@@ -0,0 +1,160 @@
+//------------------------------------------------------------------------------
+// Copyright (C) 2020 Daedalean AG
+//
+// This file is part of SW-AXI.
+//
+// SW-AXI is free software: you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+//
+// SW-AXI is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with SW-AXI.  If not, see <https://www.gnu.org/licenses/>.
+//------------------------------------------------------------------------------
+
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <sys/uio.h>
+#include <vector>
+
+namespace sw_axi {
+
+/**
+ * An io_uring driven counterpart of FrameWriter.
+ *
+ * Frames are staged in a buffer registered with the ring. A flush submits the staged data and the large frames
+ * queued since the previous flush as a chain of linked sends with a single system call. Each ring must only be used
+ * by one thread.
+ *
+ * The backend is only compiled in when the `USE_IO_URING` build option is set; otherwise `init` always fails and the
+ * callers fall back to the plain socket path.
+ */
+class UringFrameWriter {
+public:
+    UringFrameWriter() {}
+    ~UringFrameWriter();
+    UringFrameWriter(const UringFrameWriter &) = delete;
+    UringFrameWriter &operator=(const UringFrameWriter &) = delete;
+
+    /**
+     * Tell whether the io_uring backend has been compiled in
+     */
+    static bool isAvailable();
+
+    /**
+     * Set up the ring for the given socket
+     *
+     * @return 0 on success; -1 if io_uring is unavailable
+     */
+    int init(int sock);
+
+    /**
+     * Queue a frame; the body is copied to the registered buffer unless it is large, in which case the pending
+     * frames are flushed together with it right away
+     *
+     * @return 0 on success; -1 on failure
+     */
+    int add(const uint8_t *buffer, size_t size);
+
+    /**
+     * Queue a frame gathered from the given segments; large segments are sent from the caller's memory together
+     * with the pending frames right away
+     *
+     * @return 0 on success; -1 on failure
+     */
+    int add(const iovec *iov, int iovcnt);
+
+    /**
+     * Submit all the queued frames and wait for them to be sent
+     *
+     * @return 0 on success; -1 on failure
+     */
+    int flush();
+
+private:
+    struct Segment {
+        const uint8_t *external;  //!< Caller's memory or null if the segment lives in the staging buffer
+        size_t offset;  //!< Offset in the staging buffer
+        size_t size;
+    };
+
+    static const size_t STAGING_SIZE = 256 * 1024;  //!< Size of the registered buffer
+    static const size_t DIRECT_THRESHOLD = 16 * 1024;  //!< Segments larger than this are never copied
+    static const unsigned QUEUE_DEPTH = 64;
+
+    int stage(const void *data, size_t size);
+
+    struct State;
+    State *state = nullptr;
+    int sock = -1;
+    std::vector<Segment> segments;
+    size_t staged = 0;  //!< Bytes used in the staging buffer
+};
+
+/**
+ * An io_uring driven counterpart of FrameReader.
+ *
+ * A multishot receive stays armed on the socket and fills buffers provided to the kernel through a buffer ring.
+ * Frames that fit in a single receive buffer are handed out in place; only the frames straddling two buffers are
+ * assembled in a private vector.
+ */
+class UringFrameReader {
+public:
+    UringFrameReader() {}
+    ~UringFrameReader();
+    UringFrameReader(const UringFrameReader &) = delete;
+    UringFrameReader &operator=(const UringFrameReader &) = delete;
+
+    /**
+     * Set up the ring and the provided buffers for the given socket
+     *
+     * @return 0 on success; -1 if io_uring is unavailable
+     */
+    int init(int sock);
+
+    /**
+     * Wait for the next frame; the returned pointer stays valid until the next call
+     *
+     * @return a pointer to the frame body or null on failure
+     */
+    const uint8_t *next(size_t &size);
+
+    /**
+     * Wait for the next frame and copy it to the buffer vector
+     *
+     * @return 0 on success; -1 on failure
+     */
+    int read(std::vector<uint8_t> &buffer);
+
+    /**
+     * Move the provided buffers to the NUMA node of the calling thread
+     */
+    void bindToLocalNode();
+
+private:
+    static const unsigned NUM_BUFFERS = 16;  //!< Number of provided buffers; a power of two
+    static const size_t BUFFER_SIZE = 64 * 1024;
+    static const unsigned QUEUE_DEPTH = 32;
+
+    bool nextChunk();
+    void recycle();
+
+    struct State;
+    State *state = nullptr;
+    int sock = -1;
+    const uint8_t *chunk = nullptr;  //!< Receive buffer currently being parsed
+    size_t chunkSize = 0;
+    size_t chunkPos = 0;
+    unsigned chunkId = 0;
+    std::vector<uint8_t> assembly;  //!< Frame straddling receive buffers being put together
+    std::vector<uint8_t> frame;  //!< The last assembled frame
+};
+
+}  // namespace sw_axi
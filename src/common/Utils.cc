@@ -18,13 +18,93 @@
 //------------------------------------------------------------------------------
 
 #include "Utils.hh"
+#include "Placement.hh"
 
+#include <algorithm>
+#include <cerrno>
+#include <chrono>
+#include <climits>
+#include <cstring>
+#include <fcntl.h>
+#include <poll.h>
+#include <sys/socket.h>
 #include <unistd.h>
 
 namespace sw_axi {
 
 std::ostream devNull(0);
 
+int setNonBlocking(int sock) {
+    int flags = fcntl(sock, F_GETFL);
+    if (flags == -1 || fcntl(sock, F_SETFL, flags | O_NONBLOCK) == -1) {
+        return -1;
+    }
+    return 0;
+}
+
+namespace {
+/**
+ * Wait until the socket is ready for the given events
+ *
+ * @return 0 on success; -1 on failure
+ */
+int waitFor(int sock, short events) {
+    pollfd pfd = {sock, events, 0};
+    while (poll(&pfd, 1, -1) == -1) {
+        if (errno != EINTR) {
+            return -1;
+        }
+    }
+    return 0;
+}
+
+/**
+ * Read whatever is available, up to size bytes; on a non-blocking socket, keep retrying for the busy-poll budget
+ * before waiting in the kernel
+ */
+ssize_t readSome(int sock, uint8_t *ptr, size_t size, unsigned busyPollMicros) {
+    typedef std::chrono::steady_clock Clock;
+    bool spinning = false;
+    Clock::time_point deadline;
+    while (true) {
+        ssize_t rd = ::read(sock, ptr, size);
+        if (rd >= 0) {
+            return rd;
+        }
+        if (errno == EINTR) {
+            continue;
+        }
+        if (errno != EAGAIN && errno != EWOULDBLOCK) {
+            return -1;
+        }
+
+        if (!spinning && busyPollMicros) {
+            spinning = true;
+            deadline = Clock::now() + std::chrono::microseconds(busyPollMicros);
+        }
+        if (spinning && Clock::now() < deadline) {
+            cpuRelax();
+            continue;
+        }
+        if (waitFor(sock, POLLIN) == -1) {
+            return -1;
+        }
+    }
+}
+
+int readAll(int sock, uint8_t *ptr, size_t size, unsigned busyPollMicros) {
+    while (size) {
+        ssize_t rd = readSome(sock, ptr, size, busyPollMicros);
+        if (rd <= 0) {
+            return -1;
+        }
+        size -= rd;
+        ptr += rd;
+    }
+    return 0;
+}
+}  // namespace
+
 int readFromSocket(int sock, std::vector<uint8_t> &buffer) {
     if (sock == -1) {
         return -1;
@@ -56,21 +136,232 @@ int writeToSocket(int sock, const uint8_t *buffer, size_t size) {
     }
 
     uint64_t sz = size;
-    if (write(sock, &sz, sizeof(sz)) != sizeof(sz)) {
+    iovec iov[2] = {{&sz, sizeof(sz)}, {const_cast<uint8_t *>(buffer), size}};
+    return writeAll(sock, iov, 2);
+}
+
+int writeAll(int sock, iovec *iov, int iovcnt) {
+    if (sock == -1) {
         return -1;
     }
 
-    const uint8_t *ptr = buffer;
-    while (size) {
-        ssize_t written = write(sock, ptr, size);
+    while (iovcnt) {
+        ssize_t written = writev(sock, iov, std::min(iovcnt, IOV_MAX));
         if (written == -1) {
+            if (errno == EINTR) {
+                continue;
+            }
+            if ((errno == EAGAIN || errno == EWOULDBLOCK) && waitFor(sock, POLLOUT) == 0) {
+                continue;
+            }
             return -1;
         }
-        size -= written;
-        ptr += written;
+
+        while (iovcnt && size_t(written) >= iov->iov_len) {
+            written -= iov->iov_len;
+            ++iov;
+            --iovcnt;
+        }
+
+        if (iovcnt) {
+            iov->iov_base = static_cast<uint8_t *>(iov->iov_base) + written;
+            iov->iov_len -= written;
+        }
     }
 
     return 0;
 }
 
+int sendFd(int sock, int fd) {
+    if (sock == -1) {
+        return -1;
+    }
+
+    char byte = 'F';
+    iovec iov = {&byte, sizeof(byte)};
+    char control[CMSG_SPACE(sizeof(int))];
+    memset(control, 0, sizeof(control));
+
+    msghdr msg;
+    memset(&msg, 0, sizeof(msg));
+    msg.msg_iov = &iov;
+    msg.msg_iovlen = 1;
+    msg.msg_control = control;
+    msg.msg_controllen = sizeof(control);
+
+    cmsghdr *cmsg = CMSG_FIRSTHDR(&msg);
+    cmsg->cmsg_level = SOL_SOCKET;
+    cmsg->cmsg_type = SCM_RIGHTS;
+    cmsg->cmsg_len = CMSG_LEN(sizeof(int));
+    memcpy(CMSG_DATA(cmsg), &fd, sizeof(int));
+
+    if (sendmsg(sock, &msg, 0) != sizeof(byte)) {
+        return -1;
+    }
+    return 0;
+}
+
+void FrameWriter::reset(int sock) {
+    this->sock = sock;
+    staging.clear();
+}
+
+int FrameWriter::add(const uint8_t *buffer, size_t size) {
+    iovec iov = {const_cast<uint8_t *>(buffer), size};
+    return add(&iov, 1);
+}
+
+int FrameWriter::add(const iovec *iov, int iovcnt) {
+    uint64_t sz = 0;
+    for (int i = 0; i < iovcnt; ++i) {
+        sz += iov[i].iov_len;
+    }
+    const uint8_t *szPtr = reinterpret_cast<const uint8_t *>(&sz);
+    staging.insert(staging.end(), szPtr, szPtr + sizeof(sz));
+
+    if (sz >= DIRECT_THRESHOLD) {
+        std::vector<iovec> out(1, iovec{staging.data(), staging.size()});
+        out.insert(out.end(), iov, iov + iovcnt);
+        int ret = writeAll(sock, out.data(), out.size());
+        staging.clear();
+        return ret;
+    }
+
+    for (int i = 0; i < iovcnt; ++i) {
+        const uint8_t *base = static_cast<const uint8_t *>(iov[i].iov_base);
+        staging.insert(staging.end(), base, base + iov[i].iov_len);
+    }
+    if (staging.size() >= FLUSH_THRESHOLD) {
+        return flush();
+    }
+    return 0;
+}
+
+int FrameWriter::flush() {
+    if (staging.empty()) {
+        return 0;
+    }
+
+    iovec iov = {staging.data(), staging.size()};
+    int ret = writeAll(sock, &iov, 1);
+    staging.clear();
+    return ret;
+}
+
+void FrameReader::reset(int sock) {
+    this->sock = sock;
+    begin = 0;
+    end = 0;
+}
+
+void FrameReader::bindToLocalNode() {
+    moveToLocalNode(buffer.data(), buffer.size());
+}
+
+const uint8_t *FrameReader::next(size_t &size, const TailSplitter &splitter) {
+    if (sock == -1) {
+        return nullptr;
+    }
+
+    bool trySplit = bool(splitter);
+    while (true) {
+        size_t available = end - begin;
+        size_t needed = sizeof(uint64_t);
+        bool splitting = false;
+
+        if (available >= sizeof(uint64_t)) {
+            uint64_t sz;
+            memcpy(&sz, buffer.data() + begin, sizeof(sz));
+            needed += sz;
+            if (available >= needed) {
+                const uint8_t *frame = buffer.data() + begin + sizeof(sz);
+                begin += needed;
+                size = sz;
+                return frame;
+            }
+
+            // Fill the read buffer once and see if the tail of the frame can go elsewhere before growing the buffer
+            if (trySplit && needed > READ_SIZE) {
+                splitting = true;
+                if (available >= READ_SIZE) {
+                    const uint8_t *frame = nullptr;
+                    int ret = splitFrame(sz, splitter, frame);
+                    if (ret == -1) {
+                        return nullptr;
+                    }
+                    if (ret == 1) {
+                        size = sz;
+                        return frame;
+                    }
+                    trySplit = false;
+                    splitting = false;
+                }
+            }
+        }
+
+        // Move the partial frame to the front and make sure that the buffer can hold all of it
+        size_t wanted = splitting ? READ_SIZE : std::max(needed, READ_SIZE);
+        if (buffer.size() - begin < wanted || buffer.size() - end < READ_SIZE / 4) {
+            if (available) {
+                memmove(buffer.data(), buffer.data() + begin, available);
+            }
+            begin = 0;
+            end = available;
+            if (buffer.size() < wanted) {
+                buffer.resize(wanted);
+            }
+        }
+
+        ssize_t rd = readSome(sock, buffer.data() + end, buffer.size() - end, busyPollMicros);
+        if (rd <= 0) {
+            return nullptr;
+        }
+        end += rd;
+    }
+}
+
+int FrameReader::splitFrame(uint64_t size, const TailSplitter &splitter, const uint8_t *&frame) {
+    uint8_t *body = buffer.data() + begin + sizeof(size);
+    size_t buffered = end - begin - sizeof(size);
+    uint8_t *dest = nullptr;
+    size_t destSize = 0;
+
+    size_t offset = splitter(body, buffered, size, dest, destSize);
+    if (!offset || !dest || offset > buffered || offset + destSize > size) {
+        return 0;
+    }
+
+    // Part of the tail may already be buffered
+    size_t inBuffer = std::min(buffered - offset, destSize);
+    memcpy(dest, body + offset, inBuffer);
+    if (readAll(sock, dest + inBuffer, destSize - inBuffer, busyPollMicros) == -1) {
+        return -1;
+    }
+
+    size_t skip = (size - offset - destSize) - (buffered - offset - inBuffer);
+    uint8_t scratch[256];
+    while (skip) {
+        size_t len = std::min(skip, sizeof(scratch));
+        if (readAll(sock, scratch, len, busyPollMicros) == -1) {
+            return -1;
+        }
+        skip -= len;
+    }
+
+    // The head stays where it is until the next call
+    frame = body;
+    begin = end;
+    return 1;
+}
+
+int FrameReader::read(std::vector<uint8_t> &buffer) {
+    size_t size = 0;
+    const uint8_t *frame = next(size);
+    if (!frame) {
+        return -1;
+    }
+    buffer.assign(frame, frame + size);
+    return 0;
+}
+
 }  // namespace sw_axi
@@ -22,7 +22,9 @@
 #include "flatbuffers/flatbuffers.h"
 
 #include <cstdint>
+#include <functional>
 #include <ostream>
+#include <sys/uio.h>
 #include <vector>
 
 #ifdef VERBOSE
@@ -35,6 +37,25 @@ namespace sw_axi {
 
 extern std::ostream devNull;  //!< An ostream pointing to nowhere
 
+/**
+ * Tell the CPU that the calling thread is busy-waiting, so that it can save power and give way to the sibling
+ * hyper-thread
+ */
+inline void cpuRelax() {
+#if defined(__x86_64__) || defined(__i386__)
+    __builtin_ia32_pause();
+#elif defined(__aarch64__)
+    asm volatile("yield");
+#endif
+}
+
+/**
+ * Switch the socket to non-blocking mode
+ *
+ * @return 0 on success; -1 on failure
+ */
+int setNonBlocking(int sock);
+
 /**
  * Read a variable size message from a socket and put the contents in the buffer vector.
  *
@@ -54,4 +75,138 @@ int readFromSocket(int sock, std::vector<uint8_t> &buffer);
  */
 int writeToSocket(int sock, const uint8_t *buffer, size_t size);
 
+/**
+ * Write all the data described by the segments to a socket, retrying on partial writes. A non-blocking socket is
+ * waited on when its buffer is full.
+ *
+ * @return 0 on success; -1 on failure
+ */
+int writeAll(int sock, iovec *iov, int iovcnt);
+
+/**
+ * Pass a file descriptor to the peer of a UNIX domain socket.
+ *
+ * The descriptor travels as ancillary data of a single byte message.
+ *
+ * @return 0 on success; -1 on failure
+ */
+int sendFd(int sock, int fd);
+
+/**
+ * Buffered writer of size-prefixed frames.
+ *
+ * Small frames are accumulated in a staging buffer and go out together with a single system call when the writer is
+ * flushed or the buffer fills up. A large frame is written immediately, gathered with the staged data, so that its
+ * body is not copied.
+ */
+class FrameWriter {
+public:
+    explicit FrameWriter(int sock = -1) : sock(sock) {}
+
+    /**
+     * Drop all the staged data and start writing to a new socket
+     */
+    void reset(int sock);
+
+    /**
+     * Queue a frame; the body is copied unless it is large enough to be written right away
+     *
+     * @return 0 on success; -1 on failure
+     */
+    int add(const uint8_t *buffer, size_t size);
+
+    /**
+     * Queue a frame gathered from the given segments; the segments are copied unless the frame is large enough to
+     * be written right away
+     *
+     * @return 0 on success; -1 on failure
+     */
+    int add(const iovec *iov, int iovcnt);
+
+    /**
+     * Write all the staged frames to the socket
+     *
+     * @return 0 on success; -1 on failure
+     */
+    int flush();
+
+private:
+    static const size_t DIRECT_THRESHOLD = 16 * 1024;  //!< Frames larger than this are never copied
+    static const size_t FLUSH_THRESHOLD = 64 * 1024;  //!< Flush automatically when this much data is staged
+
+    int sock;
+    std::vector<uint8_t> staging;
+};
+
+/**
+ * Buffered reader of size-prefixed frames.
+ *
+ * The socket is read in large chunks into a private buffer, so that a single system call usually brings in several
+ * frames that are then handed out without further reads.
+ */
+class FrameReader {
+public:
+    /**
+     * Decides where the tail of a frame that does not fit in the read buffer goes. It gets the beginning of the
+     * frame body that is already buffered and the size of the whole body. It returns the offset in the body from
+     * which `destSize` bytes should be received straight into `dest`, or 0 to receive the frame as usual. The rest
+     * of the frame following the tail is dropped.
+     */
+    typedef std::function<size_t(const uint8_t *head, size_t headSize, size_t size, uint8_t *&dest, size_t &destSize)>
+            TailSplitter;
+
+    explicit FrameReader(int sock = -1) : sock(sock) {}
+
+    /**
+     * Drop all the buffered data and start reading from a new socket
+     */
+    void reset(int sock);
+
+    /**
+     * Have the reader spin on a non-blocking socket for the given number of microseconds before it sleeps in the
+     * kernel waiting for data; 0 makes it sleep right away, which is the only option for blocking sockets
+     */
+    void setBusyPoll(unsigned micros) {
+        busyPollMicros = micros;
+    }
+
+    /**
+     * Move the read buffer to the NUMA node of the calling thread
+     */
+    void bindToLocalNode();
+
+    /**
+     * Wait for the next frame; the returned pointer stays valid until the next call
+     *
+     * @param splitter if set, it is asked where the tail of a large frame goes; if it takes the tail, only the part of
+     *                 the frame preceding the tail is available through the returned pointer
+     *
+     * @return a pointer to the frame body or null on failure
+     */
+    const uint8_t *next(size_t &size, const TailSplitter &splitter = TailSplitter());
+
+    /**
+     * Wait for the next frame and copy it to the buffer vector
+     *
+     * @return 0 on success; -1 on failure
+     */
+    int read(std::vector<uint8_t> &buffer);
+
+private:
+    static const size_t READ_SIZE = 64 * 1024;  //!< Amount of data requested from the socket at once
+
+    /**
+     * Offer the tail of the partially buffered frame to the splitter and receive it
+     *
+     * @return 1 if the frame has been received; 0 if the splitter declined; -1 on failure
+     */
+    int splitFrame(uint64_t size, const TailSplitter &splitter, const uint8_t *&frame);
+
+    int sock;
+    unsigned busyPollMicros = 0;
+    std::vector<uint8_t> buffer;
+    size_t begin = 0;  //!< Offset of the first unconsumed byte in the buffer
+    size_t end = 0;  //!< Offset past the last valid byte in the buffer
+};
+
 }  // namespace sw_axi
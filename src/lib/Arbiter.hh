@@ -0,0 +1,140 @@
+//------------------------------------------------------------------------------
+// Copyright (C) 2020 Daedalean AG
+//
+// This file is part of SW-AXI.
+//
+// SW-AXI is free software: you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+//
+// SW-AXI is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with SW-AXI.  If not, see <https://www.gnu.org/licenses/>.
+//------------------------------------------------------------------------------
+
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <deque>
+#include <utility>
+
+namespace sw_axi {
+
+/**
+ * How the writer picks the next transaction among the lanes
+ */
+enum class Arbitration {
+    WEIGHTED_ROUND_ROBIN,  //!< Each lane in turn sends up to its weight in transactions
+    STRICT_PRIORITY  //!< The lane whose oldest transaction has the highest QoS goes first; ties are served in turn
+};
+
+/**
+ * A set of FIFO lanes drained in the order set by an arbitration policy
+ *
+ * The items of a lane always leave in the order in which they have been pushed; the policy only decides which lane
+ * goes next. Under strict priority, the QoS of the item at the head of a lane stands for the whole lane, so an
+ * urgent item queued behind less urgent ones of the same lane waits for them. Only one thread may use the arbiter.
+ */
+template<typename T>
+class Arbiter {
+public:
+    explicit Arbiter(Arbitration policy = Arbitration::WEIGHTED_ROUND_ROBIN) : policy(policy) {}
+
+    void setPolicy(Arbitration newPolicy) {
+        policy = newPolicy;
+    }
+
+    /**
+     * Add a lane that gets weight turns in a row under the weighted round-robin policy; 0 counts as 1
+     *
+     * @return the index of the lane
+     */
+    unsigned addLane(unsigned weight = 1) {
+        lanes.emplace_back();
+        lanes.back().weight = weight ? weight : 1;
+        return lanes.size() - 1;
+    }
+
+    /**
+     * Append the item to the lane
+     */
+    void push(unsigned lane, uint8_t qos, T &&item) {
+        lanes[lane].entries.emplace_back(qos, std::move(item));
+        ++queued;
+    }
+
+    /**
+     * Move the item that goes next to T
+     *
+     * @return true if an item was popped; false if all the lanes are empty
+     */
+    bool pop(T &item) {
+        if (!queued) {
+            return false;
+        }
+
+        unsigned lane = policy == Arbitration::STRICT_PRIORITY ? pickByPriority() : pickByWeight();
+        Lane &l = lanes[lane];
+        item = std::move(l.entries.front().second);
+        l.entries.pop_front();
+        --queued;
+        return true;
+    }
+
+    bool empty() const {
+        return !queued;
+    }
+
+private:
+    struct Lane {
+        std::deque<std::pair<uint8_t, T>> entries;  //!< QoS and item
+        unsigned weight = 1;
+    };
+
+    /**
+     * Stay with the current lane until it has used up its weight or has nothing left, then move to the next lane
+     * that has something
+     */
+    unsigned pickByWeight() {
+        if (served < lanes[current].weight && !lanes[current].entries.empty()) {
+            ++served;
+            return current;
+        }
+        do {
+            current = (current + 1) % lanes.size();
+        } while (lanes[current].entries.empty());
+        served = 1;
+        return current;
+    }
+
+    /**
+     * Look for the highest QoS starting after the lane served last, so that lanes of equal QoS take turns
+     */
+    unsigned pickByPriority() {
+        int best = -1;
+        unsigned bestLane = current;
+        for (size_t i = 1; i <= lanes.size(); ++i) {
+            unsigned lane = (current + i) % lanes.size();
+            if (!lanes[lane].entries.empty() && lanes[lane].entries.front().first > best) {
+                best = lanes[lane].entries.front().first;
+                bestLane = lane;
+            }
+        }
+        current = bestLane;
+        return current;
+    }
+
+    Arbitration policy;
+    std::deque<Lane> lanes;  //!< Never relocated, which lets the items be move-only
+    unsigned current = 0;  //!< The lane served last
+    unsigned served = 0;  //!< Items the current lane has sent in its turn
+    size_t queued = 0;  //!< Items in all the lanes
+};
+
+}  // namespace sw_axi
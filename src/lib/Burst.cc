@@ -0,0 +1,89 @@
+//------------------------------------------------------------------------------
+// Copyright (C) 2020 Daedalean AG
+//
+// This file is part of SW-AXI.
+//
+// SW-AXI is free software: you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+//
+// SW-AXI is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with SW-AXI.  If not, see <https://www.gnu.org/licenses/>.
+//------------------------------------------------------------------------------
+
+#include "Burst.hh"
+
+#include <algorithm>
+#include <cerrno>
+
+namespace sw_axi {
+
+namespace {
+uint16_t beatsOf(uint64_t size, unsigned beatSize) {
+    return (size + beatSize - 1) / beatSize;
+}
+}  // namespace
+
+Status splitBursts(uint64_t address, uint64_t size, unsigned beatSize, BurstType type, std::vector<Burst> &bursts) {
+    bursts.clear();
+    if (!isValidBeatSize(beatSize)) {
+        return Status(EINVAL, "The beat size needs to be a power of two no larger than 128 bytes");
+    }
+
+    if (type == BurstType::WRAP) {
+        uint64_t length = size / beatSize;
+        bool legalLength = length >= 2 && length <= MAX_FIXED_BEATS && !(length & (length - 1));
+        if (address % beatSize || size % beatSize || !legalLength) {
+            return Status(EINVAL, "A WRAP burst needs to be aligned to the beat size and span 2, 4, 8 or 16 beats");
+        }
+        bursts.push_back(Burst{address, 0, size, uint16_t(length)});
+        return Status();
+    }
+
+    if (type == BurstType::FIXED) {
+        // Every beat hits the same byte lanes, so an unaligned address narrows all of them
+        uint64_t perBeat = beatSize - address % beatSize;
+        for (uint64_t offset = 0; offset < size;) {
+            uint64_t chunk = std::min(size - offset, MAX_FIXED_BEATS * perBeat);
+            bursts.push_back(Burst{address, offset, chunk, beatsOf(chunk, perBeat)});
+            offset += chunk;
+        }
+        return Status();
+    }
+
+    for (uint64_t offset = 0; offset < size;) {
+        uint64_t first = address + offset;
+        uint64_t aligned = first - first % beatSize;
+        uint64_t end = std::min(aligned + MAX_INCR_BEATS * beatSize, first - first % BURST_BOUNDARY + BURST_BOUNDARY);
+        uint64_t chunk = std::min(size - offset, end - first);
+        bursts.push_back(Burst{first, offset, chunk, beatsOf(first - aligned + chunk, beatSize)});
+        offset += chunk;
+    }
+    return Status();
+}
+
+void sliceStrobe(const uint8_t *strobe, uint64_t offset, uint64_t size, std::vector<uint8_t> &slice) {
+    slice.assign((size + 7) / 8, 0);
+    if (offset % 8 == 0) {
+        std::copy(strobe + offset / 8, strobe + offset / 8 + slice.size(), slice.begin());
+        if (size % 8) {
+            slice.back() &= (1u << size % 8) - 1;
+        }
+        return;
+    }
+
+    for (uint64_t i = 0; i < size; ++i) {
+        uint64_t bit = offset + i;
+        if (strobe[bit / 8] & (1u << bit % 8)) {
+            slice[i / 8] |= 1u << i % 8;
+        }
+    }
+}
+
+}  // namespace sw_axi
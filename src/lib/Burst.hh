@@ -0,0 +1,78 @@
+//------------------------------------------------------------------------------
+// Copyright (C) 2020 Daedalean AG
+//
+// This file is part of SW-AXI.
+//
+// SW-AXI is free software: you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+//
+// SW-AXI is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with SW-AXI.  If not, see <https://www.gnu.org/licenses/>.
+//------------------------------------------------------------------------------
+
+#pragma once
+
+#include "../common/Data.hh"
+
+#include <cstdint>
+#include <vector>
+
+namespace sw_axi {
+
+/**
+ * One AXI burst of a transfer split by `splitBursts`
+ */
+struct Burst {
+    uint64_t address;  //!< Address of the first beat
+    uint64_t offset;  //!< Offset of the data of the burst in the buffer of the transfer
+    uint64_t size;  //!< Bytes carried by the burst
+    uint16_t length;  //!< Number of beats, AxLEN + 1
+};
+
+static const uint64_t BURST_BOUNDARY = 4096;  //!< No burst may cross an address boundary of this size
+static const unsigned MAX_INCR_BEATS = 256;
+static const unsigned MAX_FIXED_BEATS = 16;  //!< Also the maximum length of a WRAP burst
+static const unsigned MAX_BEAT_SIZE = 128;
+
+/**
+ * Tell whether beats of the given number of bytes can be expressed with AxSIZE
+ */
+inline bool isValidBeatSize(unsigned beatSize) {
+    return beatSize && beatSize <= MAX_BEAT_SIZE && !(beatSize & (beatSize - 1));
+}
+
+/**
+ * Encode the given number of bytes per beat as AxSIZE
+ */
+inline uint8_t encodeBeatSize(unsigned beatSize) {
+    uint8_t size = 0;
+    while (beatSize >>= 1) {
+        ++size;
+    }
+    return size;
+}
+
+/**
+ * Split a transfer into legal AXI4 bursts made of beats of beatSize bytes
+ *
+ * INCR bursts never cross a 4 KB boundary and have at most 256 beats; an unaligned start address only narrows the
+ * first beat. FIXED bursts have at most 16 beats, all of them at the start address. A WRAP transfer cannot be split:
+ * it has to be aligned to the beat size and to span 2, 4, 8 or 16 beats.
+ *
+ * @return an error status if the transfer cannot be expressed as bursts of the given type
+ */
+Status splitBursts(uint64_t address, uint64_t size, unsigned beatSize, BurstType type, std::vector<Burst> &bursts);
+
+/**
+ * Extract the bits of a write strobe, one bit per byte LSB first, that stand for the given bytes of the data
+ */
+void sliceStrobe(const uint8_t *strobe, uint64_t offset, uint64_t size, std::vector<uint8_t> &slice);
+
+}  // namespace sw_axi
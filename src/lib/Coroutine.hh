@@ -0,0 +1,271 @@
+//------------------------------------------------------------------------------
+// Copyright (C) 2020 Daedalean AG
+//
+// This file is part of SW-AXI.
+//
+// SW-AXI is free software: you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+//
+// SW-AXI is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with SW-AXI.  If not, see <https://www.gnu.org/licenses/>.
+//------------------------------------------------------------------------------
+
+#pragma once
+
+#include "SwAxi.hh"
+
+#ifdef __cpp_impl_coroutine
+
+#include "WorkerPool.hh"
+
+#include <condition_variable>
+#include <coroutine>
+#include <exception>
+#include <mutex>
+#include <utility>
+
+namespace sw_axi {
+
+/**
+ * Suspends a coroutine until a transaction completes
+ *
+ * The coroutine is resumed on the thread receiving the responses of the bridge, so it should hand any lengthy
+ * computation over to an executor with `co_await executor.schedule()`. The transactions it issues from there do not
+ * wait for credits; see `Master::Callback`.
+ */
+class TransactionAwaiter {
+public:
+    enum class Op { READ, WRITE, WRITE_IN_PLACE };
+
+    TransactionAwaiter(Master *master, Op op, Buffer *buffer) : master(master), op(op), buffer(buffer) {}
+
+    bool await_ready() const noexcept {
+        return false;
+    }
+
+    void await_suspend(std::coroutine_handle<> handle) {
+        // The response may arrive before this function returns, so nothing may be touched after issuing
+        Master::Callback done = [this, handle](const Status &st) {
+            status = st;
+            handle.resume();
+        };
+
+        switch (op) {
+        case Op::READ:
+            master->read(buffer, std::move(done));
+            break;
+        case Op::WRITE:
+            master->write(buffer, std::move(done));
+            break;
+        case Op::WRITE_IN_PLACE:
+            master->writeInPlace(buffer, std::move(done));
+            break;
+        }
+    }
+
+    Status await_resume() {
+        return std::move(status);
+    }
+
+private:
+    Master *master;
+    Op op;
+    Buffer *buffer;
+    Status status;
+};
+
+inline TransactionAwaiter Master::readAsync(Buffer *buffer) {
+    return TransactionAwaiter(this, TransactionAwaiter::Op::READ, buffer);
+}
+
+inline TransactionAwaiter Master::writeAsync(const Buffer *buffer) {
+    return TransactionAwaiter(this, TransactionAwaiter::Op::WRITE, const_cast<Buffer *>(buffer));
+}
+
+inline TransactionAwaiter Master::writeInPlaceAsync(const Buffer *buffer) {
+    return TransactionAwaiter(this, TransactionAwaiter::Op::WRITE_IN_PLACE, const_cast<Buffer *>(buffer));
+}
+
+class Executor;
+
+/**
+ * A lazily started coroutine without a result
+ *
+ * A task either runs to completion within the coroutine that awaits it or is handed over to an executor with
+ * `Executor::spawn`.
+ */
+class Task {
+public:
+    struct promise_type {
+        std::coroutine_handle<> continuation;  //!< The coroutine awaiting this one, if any
+        Executor *executor = nullptr;  //!< The executor that owns the task if it has been spawned
+
+        Task get_return_object() {
+            return Task(std::coroutine_handle<promise_type>::from_promise(*this));
+        }
+
+        std::suspend_always initial_suspend() noexcept {
+            return {};
+        }
+
+        struct FinalAwaiter {
+            bool await_ready() noexcept {
+                return false;
+            }
+            std::coroutine_handle<> await_suspend(std::coroutine_handle<promise_type> handle) noexcept;
+            void await_resume() noexcept {}
+        };
+
+        FinalAwaiter final_suspend() noexcept {
+            return {};
+        }
+
+        void return_void() {}
+
+        void unhandled_exception() {
+            std::terminate();
+        }
+    };
+
+    Task(Task &&other) noexcept : handle(std::exchange(other.handle, nullptr)) {}
+    Task(const Task &) = delete;
+    Task &operator=(const Task &) = delete;
+
+    ~Task() {
+        if (handle) {
+            handle.destroy();
+        }
+    }
+
+    bool await_ready() const noexcept {
+        return false;
+    }
+
+    std::coroutine_handle<> await_suspend(std::coroutine_handle<> awaiting) noexcept {
+        handle.promise().continuation = awaiting;
+        return handle;
+    }
+
+    void await_resume() noexcept {}
+
+private:
+    friend class Executor;
+
+    explicit Task(std::coroutine_handle<promise_type> handle) : handle(handle) {}
+
+    std::coroutine_handle<promise_type> handle;
+};
+
+/**
+ * Runs coroutines on a fixed set of threads
+ *
+ * Thousands of driver scripts can be spawned as tasks; a task only occupies a thread while it is running, not while
+ * it waits for a transaction.
+ */
+class Executor {
+public:
+    explicit Executor(unsigned numThreads = 1) {
+        pool.start(numThreads);
+    }
+
+    ~Executor() {
+        waitIdle();
+        pool.stop();
+    }
+
+    Executor(const Executor &) = delete;
+    Executor &operator=(const Executor &) = delete;
+
+    /**
+     * Start the task on one of the threads of the executor; the executor owns the task from now on
+     */
+    void spawn(Task task) {
+        std::coroutine_handle<Task::promise_type> handle = std::exchange(task.handle, nullptr);
+        handle.promise().executor = this;
+        {
+            std::lock_guard<std::mutex> scopedLock(mutex);
+            ++active;
+        }
+        post(handle);
+    }
+
+    /**
+     * Resume the coroutine on one of the threads of the executor
+     */
+    void post(std::coroutine_handle<> handle) {
+        pool.post([handle]() { handle.resume(); });
+    }
+
+    /**
+     * An awaitable moving the awaiting coroutine to one of the threads of the executor
+     */
+    auto schedule() {
+        struct Awaiter {
+            Executor *executor;
+            bool await_ready() const noexcept {
+                return false;
+            }
+            void await_suspend(std::coroutine_handle<> handle) {
+                executor->post(handle);
+            }
+            void await_resume() noexcept {}
+        };
+        return Awaiter{this};
+    }
+
+    /**
+     * Wait until all the spawned tasks have finished
+     */
+    void waitIdle() {
+        std::unique_lock<std::mutex> scopedLock(mutex);
+        while (active) {
+            condVar.wait(scopedLock);
+        }
+    }
+
+private:
+    friend struct Task::promise_type::FinalAwaiter;
+
+    /**
+     * Called when a spawned task finishes, possibly on a thread of the bridge; the executor may be gone as soon as
+     * the mutex is released
+     */
+    void taskDone() {
+        std::lock_guard<std::mutex> scopedLock(mutex);
+        if (!--active) {
+            condVar.notify_all();
+        }
+    }
+
+    WorkerPool pool;
+    size_t active = 0;  //!< Spawned tasks that have not finished yet
+    std::mutex mutex;
+    std::condition_variable condVar;
+};
+
+inline std::coroutine_handle<> Task::promise_type::FinalAwaiter::await_suspend(
+        std::coroutine_handle<promise_type> handle) noexcept {
+    promise_type &promise = handle.promise();
+    if (promise.continuation) {
+        return promise.continuation;
+    }
+
+    // A spawned task has nobody to return to, so it cleans up after itself
+    Executor *executor = promise.executor;
+    handle.destroy();
+    if (executor) {
+        executor->taskDone();
+    }
+    return std::noop_coroutine();
+}
+
+}  // namespace sw_axi
+
+#endif
@@ -19,63 +19,278 @@
 
 #pragma once
 
+#include "../common/Placement.hh"
+
+#include <atomic>
+#include <chrono>
 #include <condition_variable>
+#include <cstddef>
+#include <cstdint>
+#include <deque>
+#include <memory>
 #include <mutex>
-#include <queue>
+#include <new>
+#include <thread>
+#include <type_traits>
 
 namespace sw_axi {
 
 /**
- * A synchronized queue
+ * A bounded lock-free multi-producer single-consumer queue
+ *
+ * The elements live in a ring of slots, each carrying a sequence number that tells whether the slot is free for the
+ * producer at a given position or holds an element for the consumer (D. Vyukov's bounded queue). Producers claim a
+ * position with a single compare-and-swap, so pushing from many threads never takes a lock. The consumer spins for a
+ * while when the queue is empty and only then parks on a condition variable; producers take the mutex to wake it up
+ * only when it is actually parked. Producers facing a full queue park the same way until the consumer frees a slot,
+ * unless they push with `pushNoWait`, which spills to an unbounded overflow list instead.
+ *
+ * Only one thread may call `pop` and `tryPop`.
  */
-template<typename T>
+template<typename T, size_t Capacity = 1024>
 class Queue {
+    static_assert(Capacity >= 2 && !(Capacity & (Capacity - 1)), "The capacity needs to be a power of two");
+
 public:
+    Queue() : slots(new Slot[Capacity]) {
+        for (size_t i = 0; i < Capacity; ++i) {
+            slots[i].seq.store(i, std::memory_order_relaxed);
+        }
+    }
+
+    ~Queue() {
+        T t;
+        while (tryPop(t)) {
+        }
+    }
+
+    Queue(const Queue &) = delete;
+    Queue &operator=(const Queue &) = delete;
+
     /**
      * Pop the element from the front of the queue and move it to T; wait until there is an element to pop
      *
-     * @return true if an element was popped; false if the finish method has been invoked
+     * @return true if an element was popped; false if the queue is empty and the finish method has been invoked
      */
     bool pop(T &t) {
-        std::unique_lock<std::mutex> scopedLock(mutex);
+        if (busyPollMicros) {
+            auto deadline = std::chrono::steady_clock::now() + std::chrono::microseconds(busyPollMicros);
+            do {
+                for (unsigned i = 0; i < PAUSE_COUNT; ++i) {
+                    if (tryPop(t)) {
+                        return true;
+                    }
+                    if (done.load(std::memory_order_acquire)) {
+                        return tryPop(t);
+                    }
+                    backOff(i);
+                }
+            } while (std::chrono::steady_clock::now() < deadline);
+        }
 
-        while (queue.empty()) {
-            condVar.wait(scopedLock);
-            if (done) {
-                return false;
+        for (unsigned i = 0; i < SPIN_COUNT; ++i) {
+            if (tryPop(t)) {
+                return true;
+            }
+            if (done.load(std::memory_order_acquire)) {
+                return tryPop(t);
+            }
+            backOff(i);
+        }
+
+        std::unique_lock<std::mutex> scopedLock(dataMutex);
+        while (true) {
+            consumerParked.store(true, std::memory_order_relaxed);
+            std::atomic_thread_fence(std::memory_order_seq_cst);
+            bool popped = tryPop(t);
+            if (popped || done.load(std::memory_order_acquire)) {
+                consumerParked.store(false, std::memory_order_relaxed);
+                return popped || tryPop(t);
             }
+            dataCondVar.wait(scopedLock);
         }
+    }
 
-        t = std::move(queue.front());
-        queue.pop();
+    /**
+     * Pop the element from the front of the queue and move it to T if there is one; never wait
+     *
+     * @return true if an element was popped; false if the queue was empty
+     */
+    bool tryPop(T &t) {
+        Slot &slot = slots[dequeuePos & (Capacity - 1)];
+        if (slot.seq.load(std::memory_order_acquire) != dequeuePos + 1) {
+            return popOverflow(t);
+        }
+
+        T *item = slot.item();
+        t = std::move(*item);
+        item->~T();
+        slot.seq.store(dequeuePos + Capacity, std::memory_order_release);
+        ++dequeuePos;
+
+        std::atomic_thread_fence(std::memory_order_seq_cst);
+        if (producersParked.load(std::memory_order_relaxed)) {
+            { std::lock_guard<std::mutex> scopedLock(spaceMutex); }
+            spaceCondVar.notify_all();
+        }
         return true;
     }
 
     /**
-     * Move the item to the back of the queue
+     * Move the item to the back of the queue; wait for a free slot if the queue is full
      */
     void push(T &&item) {
-        mutex.lock();
-        queue.push(std::move(item));
-        mutex.unlock();
-        condVar.notify_one();
+        unsigned spins = 0;
+        size_t pos;
+        while (!tryPush(item, pos)) {
+            if (++spins < SPIN_COUNT) {
+                backOff(spins);
+            } else {
+                waitForSpace(slots[pos & (Capacity - 1)], pos);
+            }
+        }
+        wakeConsumer();
+    }
+
+    /**
+     * Move the item to the back of the queue without ever waiting; if the queue is full, the item goes to an
+     * unbounded overflow list that the consumer drains once the ring is empty
+     *
+     * Meant for the threads the consumer depends on to make progress, which must not park on it. The items pushed
+     * by a thread stay in order: as long as the overflow list is not empty, they all go there.
+     */
+    void pushNoWait(T &&item) {
+        size_t pos;
+        if (overflowSize.load(std::memory_order_acquire) || !tryPush(item, pos)) {
+            std::lock_guard<std::mutex> scopedLock(overflowMutex);
+            overflow.push_back(std::move(item));
+            overflowSize.fetch_add(1, std::memory_order_release);
+        }
+        wakeConsumer();
+    }
+
+    /**
+     * Have `pop` busy-wait for the given number of microseconds on an empty queue before it starts yielding the CPU
+     * and parks; meant for a consumer that has a core to itself. 0 disables busy waiting.
+     */
+    void setBusyPoll(unsigned micros) {
+        busyPollMicros = micros;
+    }
+
+    /**
+     * Move the slots to the NUMA node of the calling thread; meant to be called by the consumer once it has been
+     * pinned
+     */
+    void bindToLocalNode() {
+        moveToLocalNode(slots.get(), sizeof(Slot) * Capacity);
     }
 
     /**
      * The element processing is done; wake the pop caller if necessary
      */
     void finish() {
-        mutex.lock();
-        done = true;
-        mutex.unlock();
-        condVar.notify_one();
+        done.store(true, std::memory_order_release);
+        wakeConsumer();
     }
 
 private:
-    std::queue<T> queue;
-    std::mutex mutex;
-    bool done = false;
-    std::condition_variable condVar;
+    static const unsigned SPIN_COUNT = 256;  //!< Attempts made before a thread parks
+
+    struct Slot {
+        std::atomic<size_t> seq;
+        typename std::aligned_storage<sizeof(T), alignof(T)>::type storage;
+
+        T *item() {
+            return reinterpret_cast<T *>(&storage);
+        }
+    };
+
+    static const unsigned PAUSE_COUNT = 64;  //!< Attempts made before a thread starts yielding the CPU
+
+    /**
+     * Wait a little before the next attempt; the other side may need our CPU to make progress, so only the first
+     * attempts busy-wait
+     */
+    static void backOff(unsigned attempt) {
+        if (attempt >= PAUSE_COUNT) {
+            std::this_thread::yield();
+            return;
+        }
+#if defined(__x86_64__) || defined(__i386__)
+        __builtin_ia32_pause();
+#elif defined(__aarch64__)
+        asm volatile("yield");
+#endif
+    }
+
+    /**
+     * Move the item to the back of the ring if it is not full; otherwise leave it alone and set pos to the position
+     * of the full slot
+     */
+    bool tryPush(T &item, size_t &pos) {
+        pos = enqueuePos.load(std::memory_order_relaxed);
+        while (true) {
+            Slot &slot = slots[pos & (Capacity - 1)];
+            intptr_t diff = intptr_t(slot.seq.load(std::memory_order_acquire)) - intptr_t(pos);
+            if (diff == 0) {
+                if (enqueuePos.compare_exchange_weak(pos, pos + 1, std::memory_order_relaxed)) {
+                    new (&slot.storage) T(std::move(item));
+                    slot.seq.store(pos + 1, std::memory_order_release);
+                    return true;
+                }
+            } else if (diff < 0) {
+                // The slot still holds the element pushed one lap ago, so the queue is full
+                return false;
+            } else {
+                pos = enqueuePos.load(std::memory_order_relaxed);
+            }
+        }
+    }
+
+    bool popOverflow(T &t) {
+        if (!overflowSize.load(std::memory_order_acquire)) {
+            return false;
+        }
+        std::lock_guard<std::mutex> scopedLock(overflowMutex);
+        t = std::move(overflow.front());
+        overflow.pop_front();
+        overflowSize.fetch_sub(1, std::memory_order_release);
+        return true;
+    }
+
+    void wakeConsumer() {
+        std::atomic_thread_fence(std::memory_order_seq_cst);
+        if (consumerParked.load(std::memory_order_relaxed)) {
+            // The consumer holds the mutex from announcing that it parks until it waits
+            { std::lock_guard<std::mutex> scopedLock(dataMutex); }
+            dataCondVar.notify_one();
+        }
+    }
+
+    void waitForSpace(Slot &slot, size_t pos) {
+        std::unique_lock<std::mutex> scopedLock(spaceMutex);
+        producersParked.fetch_add(1, std::memory_order_relaxed);
+        std::atomic_thread_fence(std::memory_order_seq_cst);
+        if (intptr_t(slot.seq.load(std::memory_order_acquire)) - intptr_t(pos) < 0) {
+            spaceCondVar.wait(scopedLock);
+        }
+        producersParked.fetch_sub(1, std::memory_order_relaxed);
+    }
+
+    std::unique_ptr<Slot[]> slots;
+    alignas(64) std::atomic<size_t> enqueuePos{0};
+    alignas(64) size_t dequeuePos = 0;  //!< Only touched by the consumer
+    std::atomic<bool> consumerParked{false};
+    std::atomic<bool> done{false};
+    unsigned busyPollMicros = 0;
+    alignas(64) std::atomic<unsigned> producersParked{0};
+    std::mutex dataMutex;
+    std::condition_variable dataCondVar;
+    std::mutex spaceMutex;
+    std::condition_variable spaceCondVar;
+    std::atomic<size_t> overflowSize{0};
+    std::mutex overflowMutex;
+    std::deque<T> overflow;  //!< Items pushed with pushNoWait while the ring was full; guarded by overflowMutex
 };
 
 }  // namespace sw_axi
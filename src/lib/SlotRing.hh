@@ -0,0 +1,187 @@
+//------------------------------------------------------------------------------
+// Copyright (C) 2020 Daedalean AG
+//
+// This file is part of SW-AXI.
+//
+// SW-AXI is free software: you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+//
+// SW-AXI is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with SW-AXI.  If not, see <https://www.gnu.org/licenses/>.
+//------------------------------------------------------------------------------
+
+#pragma once
+
+#include <atomic>
+#include <condition_variable>
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+#include <mutex>
+
+namespace sw_axi {
+
+/**
+ * The outstanding transactions of a master, indexed by their IDs
+ *
+ * The transaction with ID n lives in slot n % Capacity, whose state holds n + 1 while the transaction is
+ * outstanding and 0 when the slot is free. A single thread inserts the transactions and a single thread takes them
+ * out, so neither needs a lock; the state of the slot hands the transaction over. The IDs grow monotonically, but
+ * responses may come back out of order, so the inserting side skips the slots that are still in use.
+ *
+ * The IDs may be split into two spaces, even and odd, each with an inserting and a taking thread of its own; as
+ * Capacity is even, the spaces use disjoint slots.
+ *
+ * The issuing threads reserve a slot before they hand a transaction over to the inserting thread; they wait while
+ * the limit of transactions in flight is reached. The limit is below the number of slots of a space, which
+ * guarantees that there always is a free slot to insert into.
+ */
+template<typename T, size_t Capacity = 1024>
+class SlotRing {
+public:
+    SlotRing() : slots(new Slot[Capacity]) {}
+
+    SlotRing(const SlotRing &) = delete;
+    SlotRing &operator=(const SlotRing &) = delete;
+
+    /**
+     * Set the number of transactions that may be in flight, across all the ID spaces, and the number of spaces, 1
+     * or 2; 0 and anything above the number of slots of a space minus one mean the latter
+     */
+    void setLimit(uint32_t newLimit, unsigned spaces = 1) {
+        numSpaces = spaces;
+        uint32_t maxLimit = Capacity / numSpaces - 1;
+        limit = newLimit && newLimit <= maxLimit ? newLimit : maxLimit;
+        for (unsigned i = 0; i < numSpaces; ++i) {
+            cursors[i].nextId = i;
+        }
+    }
+
+    /**
+     * Reserve room for a transaction if there is any; never wait
+     *
+     * @return true if the room has been reserved
+     */
+    bool tryReserve() {
+        uint32_t inFlight = reserved.load(std::memory_order_relaxed);
+        while (inFlight < limit) {
+            if (reserved.compare_exchange_weak(inFlight, inFlight + 1, std::memory_order_relaxed)) {
+                return true;
+            }
+        }
+        return false;
+    }
+
+    /**
+     * Reserve room for a transaction; wait if too many are in flight
+     */
+    void reserve() {
+        while (!tryReserve()) {
+            std::unique_lock<std::mutex> scopedLock(mutex);
+            waiters.fetch_add(1, std::memory_order_relaxed);
+            std::atomic_thread_fence(std::memory_order_seq_cst);
+            if (reserved.load(std::memory_order_relaxed) >= limit) {
+                condVar.wait(scopedLock);
+            }
+            waiters.fetch_sub(1, std::memory_order_relaxed);
+        }
+    }
+
+    /**
+     * Give back room reserved for a transaction that has not been inserted
+     */
+    void release() {
+        reserved.fetch_sub(1, std::memory_order_relaxed);
+
+        std::atomic_thread_fence(std::memory_order_seq_cst);
+        if (waiters.load(std::memory_order_relaxed)) {
+            { std::lock_guard<std::mutex> scopedLock(mutex); }
+            condVar.notify_all();
+        }
+    }
+
+    /**
+     * Store a transaction for which room has been reserved
+     *
+     * @return the ID assigned to the transaction, in the given space
+     */
+    uint64_t insert(T &&t, unsigned space = 0) {
+        uint64_t &nextId = cursors[space].nextId;
+        while (slots[nextId % Capacity].state.load(std::memory_order_acquire)) {
+            nextId += numSpaces;
+        }
+
+        uint64_t id = nextId;
+        Slot &slot = slots[id % Capacity];
+        slot.item = std::move(t);
+        slot.state.store(id + 1, std::memory_order_release);
+        nextId += numSpaces;
+        return id;
+    }
+
+    /**
+     * Find the outstanding transaction with the given ID; only the taking thread of its space may call this
+     *
+     * @return a pointer to the transaction or null if there is no such transaction
+     */
+    T *find(uint64_t id) {
+        Slot &slot = slots[id % Capacity];
+        if (slot.state.load(std::memory_order_acquire) != id + 1) {
+            return nullptr;
+        }
+        return &slot.item;
+    }
+
+    /**
+     * Move the outstanding transaction with the given ID out and release its room, unless the room is kept for
+     * another transaction, which then needs no reservation of its own
+     *
+     * @return true if the transaction has been found
+     */
+    bool take(uint64_t id, T &t, bool keepRoom = false) {
+        T *item = find(id);
+        if (!item) {
+            return false;
+        }
+
+        t = std::move(*item);
+        slots[id % Capacity].state.store(0, std::memory_order_release);
+        if (!keepRoom) {
+            release();
+        }
+        return true;
+    }
+
+private:
+    struct Slot {
+        std::atomic<uint64_t> state{0};
+        T item;
+    };
+
+    /**
+     * The next ID to try in a space; only touched by the inserting thread of the space
+     */
+    struct alignas(64) Cursor {
+        uint64_t nextId = 0;
+    };
+
+    static_assert(Capacity % 2 == 0, "The ID spaces need disjoint slots");
+
+    std::unique_ptr<Slot[]> slots;
+    Cursor cursors[2];
+    unsigned numSpaces = 1;  //!< Set before any transaction is issued
+    uint32_t limit = Capacity - 1;  //!< Set before any transaction is issued
+    alignas(64) std::atomic<uint32_t> reserved{0};
+    std::atomic<uint32_t> waiters{0};
+    std::mutex mutex;
+    std::condition_variable condVar;
+};
+
+}  // namespace sw_axi
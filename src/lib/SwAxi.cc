@@ -19,12 +19,174 @@
 
 #include "SwAxi.hh"
 #include "../common/RouterClient.hh"
+#include "Burst.hh"
 
+#include <algorithm>
+#include <cerrno>
+#include <chrono>
 #include <cstring>
 
 namespace sw_axi {
 
+namespace {
+
+/**
+ * Set on the threads sending to and receiving from the router, which must never wait for credits
+ */
+thread_local bool onTransportThread = false;
+
+}  // namespace
+
+size_t CompletionQueue::poll(Completion *completions, size_t max) {
+    std::lock_guard<std::mutex> scopedLock(mutex);
+    size_t count = std::min(max, entries.size());
+    std::move(entries.begin(), entries.begin() + count, completions);
+    entries.erase(entries.begin(), entries.begin() + count);
+    return count;
+}
+
+size_t CompletionQueue::wait(Completion *completions, size_t max) {
+    if (!max) {
+        return 0;
+    }
+
+    std::unique_lock<std::mutex> scopedLock(mutex);
+    while (entries.empty()) {
+        condVar.wait(scopedLock);
+    }
+    size_t count = std::min(max, entries.size());
+    std::move(entries.begin(), entries.begin() + count, completions);
+    entries.erase(entries.begin(), entries.begin() + count);
+    return count;
+}
+
+void CompletionQueue::push(uint64_t tag, const Status &status) {
+    {
+        std::lock_guard<std::mutex> scopedLock(mutex);
+        entries.push_back(Completion{tag, status});
+    }
+    condVar.notify_one();
+}
+
 std::future<Status> Master::read(Buffer *buffer) {
+    Txn txn = prepareRead(buffer);
+    return submitWithFuture(txn);
+}
+
+void Master::read(Buffer *buffer, uint64_t tag) {
+    Txn txn = prepareRead(buffer);
+    txn.completions = &completions;
+    txn.tag = tag;
+    submit(txn);
+}
+
+void Master::read(Buffer *buffer, Callback callback) {
+    Txn txn = prepareRead(buffer);
+    txn.callback = std::move(callback);
+    submit(txn);
+}
+
+std::future<Status> Master::write(const Buffer *buffer) {
+    Txn txn = prepareWrite(buffer, false);
+    return submitWithFuture(txn);
+}
+
+void Master::write(const Buffer *buffer, uint64_t tag) {
+    Txn txn = prepareWrite(buffer, false);
+    txn.completions = &completions;
+    txn.tag = tag;
+    submit(txn);
+}
+
+void Master::write(const Buffer *buffer, Callback callback) {
+    Txn txn = prepareWrite(buffer, false);
+    txn.callback = std::move(callback);
+    submit(txn);
+}
+
+std::future<Status> Master::writeInPlace(const Buffer *buffer) {
+    Txn txn = prepareWrite(buffer, true);
+    return submitWithFuture(txn);
+}
+
+void Master::writeInPlace(const Buffer *buffer, uint64_t tag) {
+    Txn txn = prepareWrite(buffer, true);
+    txn.completions = &completions;
+    txn.tag = tag;
+    submit(txn);
+}
+
+void Master::writeInPlace(const Buffer *buffer, Callback callback) {
+    Txn txn = prepareWrite(buffer, true);
+    txn.callback = std::move(callback);
+    submit(txn);
+}
+
+void Master::writePosted(const Buffer *buffer) {
+    Txn txn = prepareWrite(buffer, false);
+    txn.txn->posted = true;
+    txn.callback = [this](const Status &st) {
+        if (st.isError()) {
+            failPosted(st);
+        }
+    };
+    submit(txn);
+}
+
+Status Master::fence() {
+    std::lock_guard<std::mutex> fenceLock(fenceMutex);
+    std::promise<Status> done;
+    std::future<Status> future = done.get_future();
+    {
+        std::lock_guard<std::mutex> scopedLock(postedMutex);
+        if (!fencing) {
+            return Status(ECANCELED, "The bridge has stopped receiving");
+        }
+        fenceDone = &done;
+    }
+
+    // The fence follows the posted writes on the write channel
+    Txn txn;
+    txn.type = TxnType::FENCE_REQ;
+    txn.txn.reset(new Transaction);
+    txn.txn->initiator = id;
+    txn.lane = writes.lane;
+    writes.queue->push(std::move(txn));
+
+    Status st = future.get();
+    std::lock_guard<std::mutex> scopedLock(postedMutex);
+    if (st.isOk()) {
+        st = postedStatus;
+    }
+    postedStatus = Status();
+    return st;
+}
+
+void Master::failPosted(const Status &status) {
+    std::lock_guard<std::mutex> scopedLock(postedMutex);
+    if (postedStatus.isOk()) {
+        postedStatus = status;
+    }
+}
+
+void Master::completeFence(const Status &status) {
+    std::lock_guard<std::mutex> scopedLock(postedMutex);
+    if (fenceDone) {
+        fenceDone->set_value(status);
+        fenceDone = nullptr;
+    }
+}
+
+void Master::cancelFences() {
+    std::lock_guard<std::mutex> scopedLock(postedMutex);
+    fencing = false;
+    if (fenceDone) {
+        fenceDone->set_value(Status(ECANCELED, "The bridge has stopped receiving"));
+        fenceDone = nullptr;
+    }
+}
+
+Master::Txn Master::prepareRead(Buffer *buffer) {
     Txn txn;
     txn.type = TxnType::TRANSACTION;
     txn.buffer = buffer->data;
@@ -33,13 +195,15 @@ std::future<Status> Master::read(Buffer *buffer) {
     txn.txn->initiator = id;
     txn.txn->address = buffer->address;
     txn.txn->size = buffer->size;
+    txn.txn->qos = buffer->qos < 0 ? qos : std::min(buffer->qos, 15);
+    txn.txn->burst = buffer->burst;
+    txn.txn->axiId = buffer->axiId;
     txn.txn->ok = true;
-    auto future = txn.promise.get_future();
-    queue->push(std::move(txn));
-    return future;
+    txn.lane = reads.lane;
+    return txn;
 }
 
-std::future<Status> Master::write(const Buffer *buffer) {
+Master::Txn Master::prepareWrite(const Buffer *buffer, bool inPlace) {
     Txn txn;
     txn.type = TxnType::TRANSACTION;
     txn.txn.reset(new Transaction);
@@ -47,26 +211,259 @@ std::future<Status> Master::write(const Buffer *buffer) {
     txn.txn->initiator = id;
     txn.txn->address = buffer->address;
     txn.txn->size = buffer->size;
-    txn.txn->data.resize(buffer->size);
-    memcpy(txn.txn->data.data(), buffer->data, buffer->size);
+    txn.txn->qos = buffer->qos < 0 ? qos : std::min(buffer->qos, 15);
+    txn.txn->burst = buffer->burst;
+    txn.txn->axiId = buffer->axiId;
+    txn.txn->posted = postedWrites;
+    if (buffer->strobe) {
+        txn.txn->strobe.assign(buffer->strobe, buffer->strobe + (buffer->size + 7) / 8);
+    }
+    if (inPlace) {
+        txn.txn->external = buffer->data;
+    } else {
+        txn.txn->data.resize(buffer->size);
+        memcpy(txn.txn->data.data(), buffer->data, buffer->size);
+    }
     txn.txn->ok = true;
-    auto future = txn.promise.get_future();
-    queue->push(std::move(txn));
+    txn.lane = writes.lane;
+    return txn;
+}
+
+void Master::submit(Txn &txn) {
+    if (beatSize && txn.txn->size) {
+        submitBursts(txn);
+        return;
+    }
+    issue(txn);
+}
+
+void Master::submitBursts(Txn &txn) {
+    std::vector<Burst> bursts;
+    Status st = splitBursts(txn.txn->address, txn.txn->size, beatSize, txn.txn->burst, bursts);
+    if (st.isError()) {
+        complete(txn, st);
+        return;
+    }
+
+    std::shared_ptr<BurstGroup> group(new BurstGroup);
+    group->remaining = bursts.size();
+    group->transfer = std::move(txn);
+    const Transaction &transfer = *group->transfer.txn;
+    const uint8_t *payload = transfer.external ? transfer.external : transfer.data.data();
+
+    // Each burst takes a credit of its own, so the bursts go out back to back while the credits last and the next
+    // ones follow as the responses come back
+    for (const Burst &b : bursts) {
+        Txn burst;
+        burst.type = TxnType::TRANSACTION;
+        burst.txn.reset(new Transaction);
+        burst.txn->type = transfer.type;
+        burst.txn->initiator = id;
+        burst.txn->address = b.address;
+        burst.txn->size = b.size;
+        burst.txn->qos = transfer.qos;
+        burst.txn->burstLength = b.length;
+        burst.txn->burstSize = encodeBeatSize(beatSize);
+        burst.txn->burst = transfer.burst;
+        burst.txn->axiId = transfer.axiId;
+        burst.txn->posted = transfer.posted;
+        burst.txn->ok = true;
+        if (transfer.type == TransactionType::READ_REQ) {
+            burst.buffer = static_cast<uint8_t *>(group->transfer.buffer) + b.offset;
+        } else {
+            burst.txn->external = payload + b.offset;
+            if (!transfer.strobe.empty()) {
+                sliceStrobe(transfer.strobe.data(), b.offset, b.size, burst.txn->strobe);
+            }
+        }
+        burst.lane = group->transfer.lane;
+        burst.callback = [group](const Status &st) { group->complete(st); };
+        issue(burst);
+    }
+}
+
+void Master::BurstGroup::complete(const Status &st) {
+    if (st.isError()) {
+        std::lock_guard<std::mutex> scopedLock(mutex);
+        if (status.isOk()) {
+            status = st;
+        }
+    }
+
+    if (remaining.fetch_sub(1) == 1) {
+        Master::complete(transfer, status);
+    }
+}
+
+void Master::issue(Txn &txn) {
+    if (txn.txn->posted) {
+        enqueue(writes, txn);
+        return;
+    }
+
+    if (!outstanding.tryReserve()) {
+        if (!waitForCredits) {
+            complete(txn, Status(EAGAIN, "The master has no credits left"));
+            return;
+        }
+        if (onTransportThread) {
+            park(txn);
+            return;
+        }
+        outstanding.reserve();
+    }
+    enqueue(txn.txn->type == TransactionType::READ_REQ ? reads : writes, txn);
+}
+
+void Master::enqueue(const Channel &channel, Txn &txn) {
+    // A thread sticks to one kind of push, so its items keep their order even when they spill over
+    if (onTransportThread) {
+        channel.queue->pushNoWait(std::move(txn));
+    } else {
+        channel.queue->push(std::move(txn));
+    }
+}
+
+void Master::park(Txn &txn) {
+    {
+        std::lock_guard<std::mutex> scopedLock(parkedMutex);
+        parked.push_back(std::move(txn));
+    }
+    numParked.fetch_add(1, std::memory_order_relaxed);
+
+    // A credit may have come back after the reservation failed and before the transaction was parked
+    std::atomic_thread_fence(std::memory_order_seq_cst);
+    issueParked(false);
+}
+
+void Master::issueParked(bool haveRoom) {
+    while (haveRoom || (numParked.load(std::memory_order_relaxed) && outstanding.tryReserve())) {
+        haveRoom = false;
+        Txn txn;
+        {
+            std::lock_guard<std::mutex> scopedLock(parkedMutex);
+            if (parked.empty()) {
+                outstanding.release();
+                return;
+            }
+            txn = std::move(parked.front());
+            parked.pop_front();
+        }
+        numParked.fetch_sub(1, std::memory_order_relaxed);
+        enqueue(txn.txn->type == TransactionType::READ_REQ ? reads : writes, txn);
+    }
+}
+
+std::future<Status> Master::submitWithFuture(Txn &txn) {
+    txn.promise.reset(new std::promise<Status>);
+    auto future = txn.promise->get_future();
+    submit(txn);
     return future;
 }
 
+void Master::complete(Txn &txn, const Status &status) {
+    if (txn.promise) {
+        txn.promise->set_value(status);
+    } else if (txn.completions) {
+        txn.completions->push(txn.tag, status);
+    } else if (txn.callback) {
+        txn.callback(status);
+    }
+}
+
 void Master::terminate() {
-    Txn txn;
-    txn.type = TxnType::TERMINATION, txn.txn.reset(new Transaction);
-    txn.txn->id = id;
-    queue->push(std::move(txn));
+    pushTermination(id, reads, writes);
 }
 
-Bridge::Bridge(const std::string &name) : client(new RouterClient()), name(name) {}
+void Master::pushTermination(uint64_t id, const Channel &reads, const Channel &writes) {
+    // The router retires a master once it has terminated on every channel, so with split channels, each of them
+    // gets the termination behind the transactions already queued
+    for (const Channel *channel : {&reads, &writes}) {
+        if (channel == &writes && writes.queue == reads.queue) {
+            break;
+        }
+        Txn txn;
+        txn.type = TxnType::TERMINATION, txn.txn.reset(new Transaction);
+        txn.txn->id = id;
+        txn.lane = channel->lane;
+        enqueue(*channel, txn);
+    }
+}
+
+std::future<Status> StreamMaster::send(const StreamPacket *packet) {
+    std::unique_ptr<std::promise<Status>> promise(new std::promise<Status>);
+    std::future<Status> future = promise->get_future();
+
+    // The chunks are multiples of 8 bytes apart from the last one, so that each of them starts on a byte of TKEEP
+    uint64_t offset = 0;
+    do {
+        uint64_t size = packet->size - offset;
+        if (size > CHUNK_SIZE) {
+            size = CHUNK_SIZE;
+        }
+
+        Master::Txn txn;
+        txn.type = Master::TxnType::STREAM;
+        txn.chunk.reset(new StreamChunk);
+        txn.chunk->initiator = id;
+        txn.chunk->address = packet->dest;
+        txn.chunk->data = packet->data + offset;
+        txn.chunk->size = size;
+        txn.chunk->keep = packet->keep ? packet->keep + offset / 8 : nullptr;
+        txn.chunk->user = packet->user;
+        offset += size;
+        txn.chunk->more = offset < packet->size;
+        txn.chunk->last = packet->last && !txn.chunk->more;
+        txn.lane = writes.lane;
+        if (!txn.chunk->more) {
+            txn.promise = std::move(promise);
+        }
+
+        takeCredit();
+        writes.queue->push(std::move(txn));
+    } while (offset < packet->size);
+    return future;
+}
+
+void StreamMaster::terminate() {
+    Master::pushTermination(id, reads, writes);
+}
+
+void StreamMaster::takeCredit() {
+    std::unique_lock<std::mutex> scopedLock(mutex);
+    while (!credits) {
+        condVar.wait(scopedLock);
+    }
+    --credits;
+}
+
+void StreamMaster::returnCredits(uint32_t count) {
+    {
+        std::lock_guard<std::mutex> scopedLock(mutex);
+        credits += count;
+    }
+    condVar.notify_all();
+}
+
+Bridge::Connection::Connection(Arbitration arbitration) : client(new RouterClient()), lanes(arbitration) {
+    lanes.addLane();
+}
+
+Bridge::Connection::~Connection() {}
+
+Bridge::Bridge(const std::string &name, const BridgeConfig &config) :
+        numStripes(std::max(config.numConnections, 1u)), name(name), config(config) {
+    for (unsigned i = 0; i < numStripes * (config.splitChannels ? 2 : 1); ++i) {
+        connections.emplace_back(new Connection(config.arbitration));
+        connections.back()->queue.setBusyPoll(config.busyPollMicros);
+    }
+    client = connections.front()->client.get();
+    client->setBusyPoll(config.busyPollMicros);
+    client->setStripes(numStripes, config.splitChannels);
+}
 
 Bridge::~Bridge() {
     disconnect();
-    delete client;
 }
 
 Status Bridge::connect(std::string uri) {
@@ -88,18 +485,76 @@ Status Bridge::registerSlave(Slave *slave, const IpConfig &config) {
         return ret.second;
     }
     slaveMap[ret.first] = slave;
+    if (config.numInterrupts) {
+        interruptRanges.emplace_back(config.firstInterrupt, config.firstInterrupt + config.numInterrupts);
+    }
     return Status();
 }
 
-std::pair<Master *, Status> Bridge::registerMaster(const std::string &name) {
-    IpConfig config = {.name = name, .type = IpType::MASTER};
+std::pair<Master *, Status> Bridge::registerMaster(const std::string &name, const MasterConfig &config) {
+    // The router keeps whatever it has registered, so the configuration is checked before
+    if (config.beatSize && !isValidBeatSize(config.beatSize)) {
+        return std::make_pair(nullptr, Status(EINVAL, "The beat size needs to be a power of two up to 128 bytes"));
+    }
+
+    IpConfig ipConfig = {.name = name, .type = IpType::MASTER};
+    ipConfig.maxOutstanding = config.maxOutstanding;
+    uint32_t credits = 0;
+    std::pair<uint64_t, Status> ret = client->registerIp(ipConfig, &credits);
+    if (ret.second.isError()) {
+        return std::make_pair(nullptr, ret.second);
+    }
+
+    MasterConfig masterConfig = config;
+    masterConfig.qos = std::min<uint8_t>(config.qos, 15);
+    Connection &readConn = connectionFor(ret.first, TransactionType::READ_REQ);
+    Connection &writeConn = connectionFor(ret.first, TransactionType::WRITE_REQ);
+    Master::Channel reads = {&readConn.queue, readConn.lanes.addLane(config.weight)};
+    Master::Channel writes = reads;
+    if (&writeConn != &readConn) {
+        writes = {&writeConn.queue, writeConn.lanes.addLane(config.weight)};
+    }
+    Master *m = new Master(ret.first, reads, writes, masterConfig);
+    m->outstanding.setLimit(credits, &writeConn != &readConn ? 2 : 1);
+    masterMap[ret.first] = m;
+    return std::make_pair(m, Status());
+}
+
+Status Bridge::registerStreamSlave(StreamSlave *slave, const IpConfig &config) {
+    if (config.type != IpType::SLAVE_STREAM) {
+        return Status(EINVAL, "A stream slave needs to be registered as SLAVE_STREAM");
+    }
+
     std::pair<uint64_t, Status> ret = client->registerIp(config);
+    if (ret.second.isError()) {
+        return ret.second;
+    }
+    streamSlaveMap[ret.first].slave = slave;
+    if (config.numInterrupts) {
+        interruptRanges.emplace_back(config.firstInterrupt, config.firstInterrupt + config.numInterrupts);
+    }
+    return Status();
+}
+
+std::pair<StreamMaster *, Status> Bridge::registerStreamMaster(const std::string &name, const MasterConfig &config) {
+    IpConfig ipConfig = {.name = name, .type = IpType::MASTER_STREAM};
+    ipConfig.maxOutstanding = config.maxOutstanding;
+    uint32_t credits = 0;
+    std::pair<uint64_t, Status> ret = client->registerIp(ipConfig, &credits);
     if (ret.second.isError()) {
         return std::make_pair(nullptr, ret.second);
     }
 
-    Master *m = new Master(ret.first, &queue);
-    masterMap[ret.first].master = m;
+    // The stream data goes over the write channel, the reads only carry the termination
+    Connection &readConn = connectionFor(ret.first, TransactionType::READ_REQ);
+    Connection &writeConn = connectionFor(ret.first, TransactionType::WRITE_REQ);
+    Master::Channel writes = {&writeConn.queue, writeConn.lanes.addLane(config.weight)};
+    Master::Channel reads = writes;
+    if (&writeConn != &readConn) {
+        reads = {&readConn.queue, 0};
+    }
+    StreamMaster *m = new StreamMaster(ret.first, reads, writes, credits);
+    streamMasterMap[ret.first] = m;
     return std::make_pair(m, Status());
 }
 
@@ -134,21 +589,122 @@ Status Bridge::start() {
         delete ret.first;
     }
 
-    readerThread = std::thread(startReader, this);
-    writerThread = std::thread(startWriter, this);
+    for (size_t i = 1; i < connections.size(); ++i) {
+        Status st = connections[i]->client->attach(*client, i);
+        if (st.isError()) {
+            disconnect();
+            return st;
+        }
+    }
+
+    for (auto &conn : connections) {
+        conn->client->setReadSink(
+                [this](uint64_t initiator, uint64_t id, size_t size) { return readSink(initiator, id, size); });
+        conn->client->setStreamHandler([this](const StreamView &view) { return receiveStream(view); });
+        conn->client->setInterruptHandler([this](uint32_t number, uint32_t raises) {
+            deliverInterrupt(number, raises);
+            return Status();
+        });
+        Connection *c = conn.get();
+        conn->client->setFenceHandler(
+                [this, c](uint64_t master, bool response) { return receiveFence(*c, master, response); });
+    }
+    Status st = slaveWorkers.start(config.numSlaveWorkers, config.workerPlacement);
+
+    // The threads wait until they have been placed, so that the memory they move to their NUMA nodes ends up where
+    // they are going to run
+    std::promise<bool> gate;
+    std::shared_future<bool> placed = gate.get_future().share();
+    activeReaders = connections.size();
+    for (auto &conn : connections) {
+        conn->readerThread = std::thread(startReader, this, conn.get(), placed);
+        conn->writerThread = std::thread(startWriter, this, conn.get(), placed);
+        if (st.isOk()) {
+            st = placeThread(conn->readerThread.native_handle(), config.readerPlacement);
+        }
+        if (st.isOk()) {
+            st = placeThread(conn->writerThread.native_handle(), config.writerPlacement);
+        }
+    }
+    gate.set_value(st.isOk());
+
+    if (st.isError()) {
+        for (auto &conn : connections) {
+            conn->readerThread.join();
+            conn->writerThread.join();
+        }
+        slaveWorkers.stop();
+        disconnect();
+        return st;
+    }
+    return Status();
+}
+
+Status Bridge::raiseInterrupt(uint32_t number) {
+    if (client->getState() != RouterClient::State::STARTED) {
+        return Status(1, "The bridge needs to be started in order to raise interrupts");
+    }
+
+    bool allocated = std::any_of(interruptRanges.begin(), interruptRanges.end(), [number](const auto &range) {
+        return number >= range.first && number < range.second;
+    });
+    if (!allocated) {
+        return Status(EINVAL, "Interrupt " + std::to_string(number) + " is not allocated to an IP of the bridge");
+    }
+
+    // The router takes the interrupts on the control connection, with the reads
+    Master::Txn txn;
+    txn.type = Master::TxnType::INTERRUPT;
+    txn.interrupt = number;
+    connections.front()->queue.pushNoWait(std::move(txn));
+    deliverInterrupt(number, 1);
     return Status();
 }
 
+std::pair<uint32_t, Status> Bridge::waitInterrupt(uint32_t number, uint64_t timeoutMicros) {
+    std::unique_lock<std::mutex> scopedLock(interruptMutex);
+    InterruptLine &line = interruptLines[number];
+    auto woken = [this, &line] { return line.pending || !receiving; };
+    if (!timeoutMicros) {
+        interruptCondVar.wait(scopedLock, woken);
+    } else if (!interruptCondVar.wait_for(scopedLock, std::chrono::microseconds(timeoutMicros), woken)) {
+        return std::make_pair(0, Status(ETIMEDOUT, "Interrupt " + std::to_string(number) + " has not been raised"));
+    }
+
+    if (!line.pending) {
+        return std::make_pair(0, Status(ECANCELED, "The bridge has stopped receiving interrupts"));
+    }
+    uint32_t raises = line.pending;
+    line.pending = 0;
+    return std::make_pair(raises, Status());
+}
+
+void Bridge::onInterrupt(uint32_t number, InterruptCallback callback) {
+    std::lock_guard<std::mutex> scopedLock(interruptMutex);
+    interruptLines[number].callback = std::move(callback);
+}
+
 Status Bridge::waitForCompletion() {
-    readerThread.join();
-    writerThread.join();
+    // The threads have already been joined if the bridge failed to start
+    for (auto &conn : connections) {
+        if (conn->readerThread.joinable()) {
+            conn->readerThread.join();
+        }
+        if (conn->writerThread.joinable()) {
+            conn->writerThread.join();
+        }
+    }
 
-    if (readerStatus.isError()) {
-        return readerStatus;
+    for (auto &conn : connections) {
+        if (conn->readerStatus.isError()) {
+            return conn->readerStatus;
+        }
     }
 
-    if (writerStatus.isError()) {
-        return writerStatus;
+    for (auto &conn : connections) {
+        if (conn->writerStatus.isError()) {
+            return conn->writerStatus;
+        }
     }
 
     return Status();
@@ -171,7 +727,9 @@ Status Bridge::enumeratePeers(std::vector<SystemInfo> &peers) {
 }
 
 void Bridge::disconnect() {
-    client->disconnect();
+    for (auto &conn : connections) {
+        conn->client->disconnect();
+    }
     routerInfo.reset(nullptr);
     ipBlocks.clear();
 
@@ -181,135 +739,422 @@ void Bridge::disconnect() {
     slaveMap.clear();
 
     for (auto &entry : masterMap) {
-        delete entry.second.master;
+        delete entry.second;
     }
     masterMap.clear();
+
+    for (auto &entry : streamSlaveMap) {
+        delete entry.second.slave;
+    }
+    streamSlaveMap.clear();
+
+    for (auto &entry : streamMasterMap) {
+        delete entry.second;
+    }
+    streamMasterMap.clear();
+}
+
+void Bridge::reader(Connection &conn) {
+    conn.readerStatus = dispatch(conn);
+
+    // The responses of the slaves may go to any of the writers, so the writers are told to stop only when the last
+    // reader is done and the requests still being handled have queued their responses
+    if (activeReaders.fetch_sub(1) == 1) {
+        {
+            std::lock_guard<std::mutex> scopedLock(interruptMutex);
+            receiving = false;
+        }
+        interruptCondVar.notify_all();
+        for (auto &entry : masterMap) {
+            entry.second->cancelFences();
+        }
+        slaveWorkers.stop();
+        for (auto &c : connections) {
+            c->queue.finish();
+        }
+    }
 }
 
-void Bridge::reader() {
+Status Bridge::dispatch(Connection &conn) {
+    RouterClient &client = *conn.client;
     while (true) {
-        auto ret = client->receiveTransaction();
+        auto ret = client.receiveTransactionView();
         if (ret.second.isError()) {
-            if (ret.second.getCode() != client->DONE) {
-                readerStatus = ret.second;
-            } else {
-                readerStatus = Status();
+            if (ret.second.getCode() != client.DONE) {
+                return ret.second;
             }
-            queue.finish();
-            return;
+            return Status();
         }
 
-        std::unique_ptr<Transaction> txn(ret.first);
+        // The payload is consumed in place, straight from the receive buffer of the client
+        const TransactionView &txn = ret.first;
 
-        if (txn->type == TransactionType::READ_RESP || txn->type == TransactionType::WRITE_RESP) {
-            const std::lock_guard<std::mutex> lock(masterMapMutex);
-            if (masterMap.find(txn->initiator) == masterMap.end()) {
-                readerStatus = Status(1, "Got a response for an unknown master: " + std::to_string(txn->initiator));
-                queue.finish();
-                return;
+        if (txn.getType() == TransactionType::READ_RESP || txn.getType() == TransactionType::WRITE_RESP) {
+            auto masterIt = masterMap.find(txn.getInitiator());
+            if (masterIt == masterMap.end()) {
+                return Status(1, "Got a response for an unknown master: " + std::to_string(txn.getInitiator()));
             }
-            auto &masterMd = masterMap[txn->initiator];
 
-            if (masterMd.txns.find(txn->id) == masterMd.txns.end()) {
-                readerStatus = Status(1, "Got a response for an unknown request: " + std::to_string(txn->id));
-                queue.finish();
-                return;
+            // A posted write is only answered if it fails and has no outstanding transaction to complete
+            if (txn.isPosted()) {
+                masterIt->second->failPosted(Status(1, txn.getMessage()));
+                continue;
+            }
+
+            // The credit goes straight to a parked transaction, so that the threads waiting for credits cannot
+            // take it first
+            Master *master = masterIt->second;
+            bool handOver = master->numParked.load(std::memory_order_relaxed) != 0;
+            Master::Txn mTxn;
+            if (!master->outstanding.take(txn.getId(), mTxn, handOver)) {
+                return Status(1, "Got a response for an unknown request: " + std::to_string(txn.getId()));
+            }
+            if (handOver || master->numParked.load(std::memory_order_relaxed)) {
+                master->issueParked(handOver);
             }
-            auto mTxn = std::move(masterMd.txns[txn->id]);
-            masterMd.txns.erase(txn->id);
 
             auto st = Status();
-            if (!txn->ok) {
-                st = Status(1, txn->message);
+            if (!txn.isOk()) {
+                st = Status(1, txn.getMessage());
             }
 
-            if (txn->type == TransactionType::READ_RESP && txn->ok) {
-                memcpy(mTxn.buffer, txn->data.data(), txn->data.size());
+            // Large payloads may have been received straight into the user's buffer already
+            if (txn.getType() == TransactionType::READ_RESP && txn.isOk() && txn.getData() != mTxn.buffer) {
+                memcpy(mTxn.buffer, txn.getData(), std::min<uint64_t>(txn.getDataSize(), mTxn.txn->size));
             }
 
-            mTxn.promise.set_value(st);
-        } else if (txn->type == TransactionType::READ_REQ || txn->type == TransactionType::WRITE_REQ) {
-            if (slaveMap.find(txn->target) == slaveMap.end()) {
-                readerStatus = Status(1, "Got a request meant for an unknown slave: " + std::to_string(txn->target));
-                queue.finish();
-                return;
+            Master::complete(mTxn, st);
+        } else if (txn.getType() == TransactionType::READ_REQ || txn.getType() == TransactionType::WRITE_REQ) {
+            auto slaveIt = slaveMap.find(txn.getTarget());
+            if (slaveIt == slaveMap.end()) {
+                return Status(1, "Got a request meant for an unknown slave: " + std::to_string(txn.getTarget()));
             }
+            Slave *s = slaveIt->second;
 
-            Transaction *respTxn = new Transaction;
-            Slave *s = slaveMap[txn->target];
-            int ret = 0;
-            Buffer b = {.size = txn->size, .address = txn->address};
-
-            if (txn->type == TransactionType::WRITE_REQ) {
-                b.data = txn->data.data();
-                respTxn->type = TransactionType::WRITE_RESP;
-                ret = s->handleWrite(&b);
-            } else {
-                respTxn->data.resize(txn->size);
-                b.data = respTxn->data.data();
-                respTxn->type = TransactionType::READ_RESP;
-                ret = s->handleRead(&b);
+            // Both paths below hand the slave a strobe of the size of the request, which it reads in full
+            if (txn.getStrobe() && txn.getStrobeSize() != (txn.getSize() + 7) / 8) {
+                Transaction req;
+                txn.copyTo(req);
+                Transaction *respTxn = new Transaction;
+                respTxn->type = req.type == TransactionType::WRITE_REQ ? TransactionType::WRITE_RESP
+                                                                       : TransactionType::READ_RESP;
+                respTxn->ok = false;
+                respTxn->message = "The strobe of the request does not match its size";
+                respond(req, respTxn);
+                continue;
             }
 
-            respTxn->initiator = txn->initiator;
-            respTxn->target = txn->target;
-            respTxn->id = txn->id;
-            respTxn->address = txn->address;
-            respTxn->size = txn->size;
-            respTxn->ok = true;
+            if (!slaveWorkers.isRunning()) {
+                Transaction req;
+                req.type = txn.getType();
+                req.initiator = txn.getInitiator();
+                req.target = txn.getTarget();
+                req.id = txn.getId();
+                req.address = txn.getAddress();
+                req.size = txn.getSize();
+                req.qos = txn.getQos();
+                req.burstLength = txn.getBurstLength();
+                req.burstSize = txn.getBurstSize();
+                req.burst = txn.getBurst();
+                req.axiId = txn.getAxiId();
+                req.posted = txn.isPosted();
+                if (txn.getStrobe()) {
+                    req.strobe.assign(txn.getStrobe(), txn.getStrobe() + txn.getStrobeSize());
+                }
+                serve(s, req, txn.getData());
+                continue;
+            }
 
-            if (ret) {
-                respTxn->data.clear();
-                respTxn->ok = false;
-                respTxn->message = "Slave operation failed";
+            // The receive buffer is reused for the next transaction, so the workers get their own copy
+            std::shared_ptr<Transaction> req(new Transaction);
+            txn.copyTo(*req);
+            auto job = [this, s, req]() { serve(s, *req, req->data.data()); };
+            if (s->isReentrant() && !req->posted) {
+                slaveWorkers.post(job);
+                continue;
             }
 
-            Master::Txn mTxn;
-            mTxn.type = Master::TxnType::TRANSACTION;
-            mTxn.txn.reset(respTxn);
-            queue.push(std::move(mTxn));
+            // A slave completing out of order gets a strand per AXI ID, the others a single strand; the posted
+            // writes to a reentrant slave get a strand per AXI ID as well, so that a fence can queue up behind them
+            uint64_t strand = req->target << 32;
+            if (s->completesOutOfOrder() || s->isReentrant()) {
+                strand |= req->axiId;
+            }
+            if (req->posted) {
+                conn.postedStrands[req->initiator].insert(strand);
+            }
+            slaveWorkers.post(strand, job);
         }
     }
 }
 
-void Bridge::writer() {
-    while (true) {
-        Master::Txn txn;
-        if (!queue.pop(txn)) {
-            writerStatus = Status();
-            writerStatus = client->sendLogout();
-            return;
+void Bridge::serve(Slave *slave, const Transaction &req, const uint8_t *payload) {
+    Transaction *respTxn = new Transaction;
+    int ret = 0;
+    Buffer b = {.size = req.size, .address = req.address, .qos = req.qos};
+    b.burst = req.burst;
+    b.burstLength = req.burstLength;
+    b.burstSize = req.burstSize;
+    b.axiId = req.axiId;
+    b.strobe = req.strobe.empty() ? nullptr : req.strobe.data();
+
+    if (req.type == TransactionType::WRITE_REQ) {
+        b.data = const_cast<uint8_t *>(payload);
+        respTxn->type = TransactionType::WRITE_RESP;
+        ret = slave->handleWrite(&b);
+    } else {
+        respTxn->data.resize(req.size);
+        b.data = respTxn->data.data();
+        respTxn->type = TransactionType::READ_RESP;
+        ret = slave->handleRead(&b);
+    }
+
+    respTxn->ok = !ret;
+    if (ret) {
+        respTxn->data.clear();
+        respTxn->message = "Slave operation failed";
+    }
+    respond(req, respTxn);
+}
+
+void Bridge::respond(const Transaction &req, Transaction *respTxn) {
+    respTxn->initiator = req.initiator;
+    respTxn->target = req.target;
+    respTxn->id = req.id;
+    respTxn->address = req.address;
+    respTxn->size = req.size;
+    respTxn->qos = req.qos;
+    respTxn->burstLength = req.burstLength;
+    respTxn->burstSize = req.burstSize;
+    respTxn->burst = req.burst;
+    respTxn->axiId = req.axiId;
+    respTxn->posted = req.posted;
+    if (respTxn->ok && req.posted) {
+        delete respTxn;
+        return;
+    }
+
+    Master::Txn mTxn;
+    mTxn.type = Master::TxnType::TRANSACTION;
+    mTxn.txn.reset(respTxn);
+    // Inline responses come from the reader thread, which must keep draining the socket for the writer to make
+    // progress, so a full queue spills over instead of parking it
+    connectionFor(req.target, respTxn->type).queue.pushNoWait(std::move(mTxn));
+}
+
+Status Bridge::receiveStream(const StreamView &view) {
+    if (view.isCredit()) {
+        auto masterIt = streamMasterMap.find(view.getInitiator());
+        if (masterIt == streamMasterMap.end()) {
+            return Status(1, "Got credits for an unknown stream master: " + std::to_string(view.getInitiator()));
+        }
+        masterIt->second->returnCredits(view.getCredits());
+        return Status();
+    }
+
+    auto slaveIt = streamSlaveMap.find(view.getTarget());
+    if (slaveIt == streamSlaveMap.end()) {
+        return Status(1, "Got stream data meant for an unknown slave: " + std::to_string(view.getTarget()));
+    }
+    StreamSink::Piece &piece = slaveIt->second.pieces[view.getInitiator()];
+    ++piece.chunks;
+
+    StreamPacket packet = {.data = view.getData(), .size = view.getDataSize(), .dest = view.getAddress()};
+    packet.keep = view.getKeep();
+    packet.user = view.getUser();
+    packet.last = view.isLast();
+
+    // A piece that came in a single chunk is handed out straight from the receive buffer
+    if (piece.chunks > 1 || view.hasMore()) {
+        piece.data.insert(piece.data.end(), packet.data, packet.data + packet.size);
+        if (packet.keep) {
+            piece.keep.insert(piece.keep.end(), packet.keep, packet.keep + (packet.size + 7) / 8);
+        }
+        if (view.hasMore()) {
+            return Status();
         }
+        packet.data = piece.data.data();
+        packet.size = piece.data.size();
+        packet.keep = packet.keep ? piece.keep.data() : nullptr;
+    }
+
+    slaveIt->second.slave->onPacket(&packet);
+
+    Master::Txn txn;
+    txn.type = Master::TxnType::STREAM_CREDIT;
+    txn.txn.reset(new Transaction);
+    txn.txn->initiator = view.getInitiator();
+    txn.credits = piece.chunks;
+    piece.chunks = 0;
+    piece.data.clear();
+    piece.keep.clear();
+    connectionFor(view.getTarget(), TransactionType::WRITE_RESP).queue.pushNoWait(std::move(txn));
+    return Status();
+}
+
+Status Bridge::receiveFence(Connection &conn, uint64_t master, bool response) {
+    if (response) {
+        auto masterIt = masterMap.find(master);
+        if (masterIt == masterMap.end()) {
+            return Status(1, "Got a fence response for an unknown master: " + std::to_string(master));
+        }
+        masterIt->second->completeFence(Status());
+        return Status();
+    }
+
+    Master::Txn txn;
+    txn.type = Master::TxnType::FENCE_RESP;
+    txn.txn.reset(new Transaction);
+    txn.txn->initiator = master;
+
+    auto strandsIt = conn.postedStrands.find(master);
+    if (strandsIt == conn.postedStrands.end()) {
+        conn.queue.pushNoWait(std::move(txn));
+        return Status();
+    }
+
+    // The answer needs to follow the failures of the writes received before the fence, so a marker goes behind
+    // them on each of their strands and the last marker to run queues the answer
+    struct FenceMarkers {
+        std::atomic<size_t> remaining;
+        Master::Txn response;
+    };
+    std::shared_ptr<FenceMarkers> markers(new FenceMarkers);
+    markers->remaining = strandsIt->second.size();
+    markers->response = std::move(txn);
+    Queue<Master::Txn> *queue = &conn.queue;
+    for (uint64_t strand : strandsIt->second) {
+        slaveWorkers.post(strand, [markers, queue]() {
+            if (markers->remaining.fetch_sub(1) == 1) {
+                queue->pushNoWait(std::move(markers->response));
+            }
+        });
+    }
+    conn.postedStrands.erase(strandsIt);
+    return Status();
+}
 
-        Transaction *t = txn.txn.get();
-        if (txn.type == Master::TxnType::TERMINATION) {
-            Status st = client->sendTermination(txn.txn->id);
+void Bridge::deliverInterrupt(uint32_t number, uint32_t raises) {
+    InterruptCallback callback;
+    {
+        std::lock_guard<std::mutex> scopedLock(interruptMutex);
+        InterruptLine &line = interruptLines[number];
+        line.pending += raises;
+        callback = line.callback;
+    }
+    interruptCondVar.notify_all();
+
+    if (callback) {
+        callback(number, raises);
+    }
+}
+
+uint8_t *Bridge::readSink(uint64_t initiator, uint64_t id, size_t size) {
+    auto masterIt = masterMap.find(initiator);
+    if (masterIt == masterMap.end()) {
+        return nullptr;
+    }
+
+    const Master::Txn *mTxn = masterIt->second->outstanding.find(id);
+    if (!mTxn || mTxn->txn->type != TransactionType::READ_REQ || mTxn->txn->size < size) {
+        return nullptr;
+    }
+    return static_cast<uint8_t *>(mTxn->buffer);
+}
+
+void Bridge::writer(Connection &conn) {
+    Queue<Master::Txn> &queue = conn.queue;
+    Arbiter<Master::Txn> &lanes = conn.lanes;
+    Master::Txn txn;
+    while (queue.pop(txn)) {
+        lanes.push(txn.lane, txn.getQos(), std::move(txn));
+
+        // Sort everything submitted so far into the lanes before each pick, so that a latecomer with a higher
+        // priority can overtake; send until the lanes run dry and flush with the last one, so that the transactions
+        // travel together in one batch message and one system call
+        do {
+            while (queue.tryPop(txn)) {
+                lanes.push(txn.lane, txn.getQos(), std::move(txn));
+            }
+            lanes.pop(txn);
+            Status st = send(*conn.client, txn, lanes.empty());
             if (st.isError()) {
-                writerStatus = st;
+                conn.writerStatus = st;
                 return;
             }
-            continue;
-        }
+        } while (!lanes.empty());
+    }
+
+    conn.writerStatus = conn.client->sendLogout();
+}
+
+Status Bridge::send(RouterClient &client, Master::Txn &txn, bool flush) {
+    Transaction *t = txn.txn.get();
+    if (txn.type == Master::TxnType::TERMINATION) {
+        return client.sendTermination(t->id, flush);
+    }
 
-        if (txn.txn->type == TransactionType::READ_REQ || txn.txn->type == TransactionType::WRITE_REQ) {
-            const std::lock_guard<std::mutex> lock(masterMapMutex);
-            txn.txn->id = masterMap[txn.txn->initiator].lastTxnId++;
-            masterMap[txn.txn->initiator].txns[txn.txn->id] = std::move(txn);
+    if (txn.type == Master::TxnType::STREAM) {
+        Status st = client.sendStreamChunk(*txn.chunk, flush);
+        if (st.isOk()) {
+            Master::complete(txn, st);
         }
+        return st;
+    }
 
-        Status st = client->sendTransaction(*t);
-        if (st.isError()) {
-            writerStatus = st;
-            return;
+    if (txn.type == Master::TxnType::STREAM_CREDIT) {
+        return client.sendStreamCredit(t->initiator, txn.credits, flush);
+    }
+
+    if (txn.type == Master::TxnType::INTERRUPT) {
+        return client.sendInterrupt(txn.interrupt, flush);
+    }
+
+    if (txn.type == Master::TxnType::FENCE_REQ || txn.type == Master::TxnType::FENCE_RESP) {
+        return client.sendFence(t->initiator, txn.type == Master::TxnType::FENCE_RESP, flush);
+    }
+
+    // A posted write expects no response, so it completes once it is on its way
+    if (t->type == TransactionType::WRITE_REQ && t->posted) {
+        Status st = client.sendTransaction(*t, flush);
+        if (st.isOk()) {
+            Master::complete(txn, st);
         }
+        return st;
     }
+
+    if (t->type == TransactionType::READ_REQ || t->type == TransactionType::WRITE_REQ) {
+        // With split channels, the reads and the writes are sent and received by threads of their own, so they take
+        // their IDs from spaces of their own
+        Master *m = masterMap.at(t->initiator);
+        unsigned space = t->type == TransactionType::WRITE_REQ && m->writes.queue != m->reads.queue ? 1 : 0;
+
+        // The response cannot come back before the transaction is sent, so it can be published before that
+        t->id = m->outstanding.insert(std::move(txn), space);
+    }
+
+    return client.sendTransaction(*t, flush);
 }
 
-void Bridge::startReader(sw_axi::Bridge *b) {
-    b->reader();
+void Bridge::startReader(sw_axi::Bridge *b, Connection *conn, std::shared_future<bool> placed) {
+    if (!placed.get()) {
+        return;
+    }
+    if (!b->config.readerPlacement.cpus.empty()) {
+        conn->client->bindToLocalNode();
+    }
+    onTransportThread = true;
+    b->reader(*conn);
 }
-void Bridge::startWriter(sw_axi::Bridge *b) {
-    b->writer();
+void Bridge::startWriter(sw_axi::Bridge *b, Connection *conn, std::shared_future<bool> placed) {
+    if (!placed.get()) {
+        return;
+    }
+    if (!b->config.writerPlacement.cpus.empty()) {
+        conn->queue.bindToLocalNode();
+    }
+    onTransportThread = true;
+    b->writer(*conn);
 }
 
 }  // namespace sw_axi
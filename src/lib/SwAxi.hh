@@ -20,13 +20,22 @@
 #pragma once
 
 #include "../common/Data.hh"
+#include "../common/Placement.hh"
+#include "Arbiter.hh"
 #include "Queue.hh"
+#include "SlotRing.hh"
+#include "WorkerPool.hh"
 
+#include <atomic>
+#include <condition_variable>
 #include <cstdint>
+#include <deque>
+#include <functional>
 #include <future>
 #include <map>
 #include <memory>
 #include <mutex>
+#include <set>
 #include <string>
 #include <thread>
 #include <utility>
@@ -35,6 +44,7 @@
 namespace sw_axi {
 
 class Bridge;
+class TransactionAwaiter;
 
 /**
  * Bus transaction data
@@ -43,6 +53,33 @@ struct Buffer {
     uint8_t *data;  //!< Payload of the transaction for write requests, buffer to be filled by read requests
     uint64_t size;  //!< Size of the data buffer in bytes
     uint64_t address;  //!< Address of the transaction
+
+    /**
+     * AxQOS of the transaction, from 0 to 15, higher values being more important; a negative value takes the
+     * default of the issuing master. The requests handed to slaves carry the QoS they have been issued with.
+     */
+    int qos = -1;
+
+    /**
+     * How the addresses of the beats advance when the master splits the transfer into bursts; the data of a WRAP
+     * burst is in the order of the beats, starting at the address
+     */
+    BurstType burst = BurstType::INCR;
+
+    uint16_t burstLength = 0;  //!< Number of beats of the request handed to a slave; 0 if it is not a burst
+    uint8_t burstSize = 0;  //!< Bytes per beat of the request handed to a slave as a power of two
+
+    /**
+     * AXI ID of the transaction; a slave that completes out of order handles the requests with different IDs
+     * independently of each other, so a slow request does not hold back those issued after it with other IDs
+     */
+    uint32_t axiId = 0;
+
+    /**
+     * WSTRB of a write, one bit per byte of the data, LSB first; the slave leaves the bytes whose bit is clear
+     * untouched. Null if all the bytes are written; ignored for reads.
+     */
+    const uint8_t *strobe = nullptr;
 };
 
 /**
@@ -53,7 +90,8 @@ public:
     virtual ~Slave() {}
 
     /**
-     * Handle the write transaction specified by the argument
+     * Handle the write transaction specified by the argument; the payload is only valid for the duration of the
+     * call
      *
      * @return 0 on success; -1 on failure
      */
@@ -65,12 +103,124 @@ public:
      * @return 0 on success; -1 on failure
      */
     virtual int handleRead(Buffer *buffer) = 0;
+
+    /**
+     * Tell whether the handlers may run concurrently on several slave workers; if not, the requests are handled one
+     * at a time, in the order in which they have arrived. Posted writes with the same AXI ID are handled in order
+     * even by a reentrant slave.
+     */
+    virtual bool isReentrant() const {
+        return false;
+    }
+
+    /**
+     * Tell whether the requests with different AXI IDs may be handled concurrently on several slave workers and so
+     * complete out of order; the requests with the same ID are still handled one at a time, in the order in which
+     * they have arrived. Only matters for a slave that is not reentrant.
+     */
+    virtual bool completesOutOfOrder() const {
+        return false;
+    }
+};
+
+/**
+ * The outcome of a transaction issued with a tag
+ */
+struct Completion {
+    uint64_t tag;  //!< Tag passed by the issuer of the transaction
+    Status status;
 };
 
+/**
+ * Completions of the tagged transactions of a master, in the order in which the responses have arrived
+ */
+class CompletionQueue {
+    friend class Master;
+
+public:
+    /**
+     * Move up to max completions to the array; never wait
+     *
+     * @return the number of completions moved
+     */
+    size_t poll(Completion *completions, size_t max);
+
+    /**
+     * Move up to max completions to the array; wait until there is at least one
+     *
+     * @return the number of completions moved
+     */
+    size_t wait(Completion *completions, size_t max);
+
+private:
+    void push(uint64_t tag, const Status &status);
+
+    std::deque<Completion> entries;
+    std::mutex mutex;
+    std::condition_variable condVar;
+};
+
+/**
+ * Parameters of a software master
+ */
+struct MasterConfig {
+    /**
+     * Transactions the master wants to have in flight at most; 0 takes the router's default; the router may grant
+     * fewer and the bridge never allows more than 1023, or 511 with split channels
+     */
+    uint32_t maxOutstanding = 0;
+
+    /**
+     * What to do when a transaction is issued while all the credits are in use: wait for a response if true;
+     * complete the transaction right away with the EAGAIN status code otherwise
+     */
+    bool waitForCredits = true;
+
+    uint8_t qos = 0;  //!< AxQOS of the transactions that do not set their own, from 0 to 15
+
+    /**
+     * Transactions the master sends in a row when its turn comes under weighted round-robin arbitration
+     */
+    unsigned weight = 1;
+
+    /**
+     * Bytes per beat of the data bus of the master, a power of two up to 128; when set, every transfer is split
+     * into legal AXI4 bursts that are all put in flight at once, as far as the credits go, and the transfer
+     * completes when the last of them does. 0 sends each transfer as a single transaction of arbitrary size.
+     */
+    unsigned beatSize = 0;
+
+    /**
+     * Post all the writes of the master: a posted write takes no credit, completes as soon as it has been sent, and
+     * is only answered by its slave if it fails; the failures are reported by `Master::fence`
+     */
+    bool postedWrites = false;
+};
+
+/**
+ * The interface for issuing transactions from software
+ *
+ * A master has a number of credits negotiated with the router and each transaction in flight uses one of them.
+ * Issuing a transaction when there are no credits left either waits until a response arrives or fails, as set in
+ * the MasterConfig.
+ *
+ * The transactions of each master wait for the writer in a lane of their own, so that a master streaming large
+ * writes does not hold back the others; the bridge configuration decides how the lanes share the link. When the
+ * bridge splits the channels, the reads and the writes of a master travel independently and are only kept in order
+ * among themselves, as on AXI.
+ */
 class Master {
     friend class Bridge;
+    friend class StreamMaster;
 
 public:
+    /**
+     * Called with the status of a transaction when it completes; runs on the thread receiving the responses (the
+     * thread sending the request for a posted write), so it must not block. Transactions issued from there never
+     * wait for credits: when the master is out of them, they are held back until a response returns one.
+     */
+    typedef std::function<void(const Status &)> Callback;
+
     /**
      * Issue a read transaction specified by the argument
      *
@@ -79,6 +229,16 @@ public:
      */
     std::future<Status> read(Buffer *buffer);
 
+    /**
+     * Issue a read transaction and report its completion with the given tag through the completion queue
+     */
+    void read(Buffer *buffer, uint64_t tag);
+
+    /**
+     * Issue a read transaction and call the callback when it completes
+     */
+    void read(Buffer *buffer, Callback callback);
+
     /**
      * Issue a write transaction specified by the argument
      *
@@ -87,27 +247,328 @@ public:
      */
     std::future<Status> write(const Buffer *buffer);
 
+    /**
+     * Issue a write transaction and report its completion with the given tag through the completion queue
+     */
+    void write(const Buffer *buffer, uint64_t tag);
+
+    /**
+     * Issue a write transaction and call the callback when it completes
+     */
+    void write(const Buffer *buffer, Callback callback);
+
+    /**
+     * Issue a write transaction without copying the payload; the data is written to the transport straight from
+     * the buffer
+     *
+     * The caller must keep the data of the buffer valid and unchanged until the transaction completes.
+     *
+     * @return A future containing status of the operation when it completes
+     */
+    std::future<Status> writeInPlace(const Buffer *buffer);
+
+    /**
+     * Issue a write transaction without copying the payload and report its completion with the given tag through
+     * the completion queue
+     */
+    void writeInPlace(const Buffer *buffer, uint64_t tag);
+
+    /**
+     * Issue a write transaction without copying the payload and call the callback when it completes
+     */
+    void writeInPlace(const Buffer *buffer, Callback callback);
+
+    /**
+     * Issue a posted write, whatever the configuration of the master; the payload is copied and the failure of the
+     * write is only reported by the next `fence`
+     */
+    void writePosted(const Buffer *buffer);
+
+    /**
+     * Wait until the slaves have handled all the posted writes issued before
+     *
+     * Only one fence of a master is in progress at a time; a concurrent call waits for the previous one to finish.
+     *
+     * @return the first failure of a posted write since the previous fence; ECANCELED if the bridge has stopped
+     *         receiving or stops before the fence completes
+     */
+    Status fence();
+
+#ifdef __cpp_impl_coroutine
+    /**
+     * Issue a read transaction and suspend the awaiting coroutine until it completes; see Coroutine.hh
+     */
+    TransactionAwaiter readAsync(Buffer *buffer);
+
+    /**
+     * Issue a write transaction and suspend the awaiting coroutine until it completes; see Coroutine.hh
+     */
+    TransactionAwaiter writeAsync(const Buffer *buffer);
+
+    /**
+     * Issue a write transaction without copying the payload and suspend the awaiting coroutine until it
+     * completes; see Coroutine.hh
+     */
+    TransactionAwaiter writeInPlaceAsync(const Buffer *buffer);
+#endif
+
+    /**
+     * Get the queue receiving the completions of the tagged transactions
+     */
+    CompletionQueue &getCompletionQueue() {
+        return completions;
+    }
+
     /**
      * Terminate the master; no further operation will be allowed
      */
     void terminate();
 
 private:
-    enum class TxnType { TRANSACTION, TERMINATION };
+    enum class TxnType { TRANSACTION, TERMINATION, STREAM, STREAM_CREDIT, INTERRUPT, FENCE_REQ, FENCE_RESP };
 
     struct Txn {
         TxnType type;
         void *buffer = nullptr;
         std::unique_ptr<Transaction> txn;
-        std::promise<Status> promise;  //!< Promise to be fulfilled when the response arrives
+        std::unique_ptr<std::promise<Status>> promise;  //!< Fulfilled when the response arrives if there is one
+        CompletionQueue *completions = nullptr;  //!< Gets the completion if the transaction has been tagged
+        uint64_t tag = 0;
+        Callback callback;
+        unsigned lane = 0;  //!< Lane of the issuing master in the writer; responses of the slaves use lane 0
+        std::unique_ptr<StreamChunk> chunk;  //!< The data of a STREAM item
+        uint32_t credits = 0;  //!< Chunks given back to the stream master named by the initiator of a STREAM_CREDIT
+        uint32_t interrupt = 0;  //!< Line raised by an INTERRUPT item
+
+        uint8_t getQos() const {
+            return txn ? txn->qos : 0;
+        }
+    };
+
+    /**
+     * A transfer split into bursts, kept alive by the bursts until the last of them completes
+     */
+    struct BurstGroup {
+        Txn transfer;  //!< Holds the payload of the bursts and gets the completion
+        std::atomic<size_t> remaining;
+        std::mutex mutex;
+        Status status;  //!< The first failure of a burst
+
+        void complete(const Status &st);
+    };
+
+    static void complete(Txn &txn, const Status &status);
+    Txn prepareRead(Buffer *buffer);
+    Txn prepareWrite(const Buffer *buffer, bool inPlace);
+    void submit(Txn &txn);
+    void submitBursts(Txn &txn);
+    void issue(Txn &txn);
+    std::future<Status> submitWithFuture(Txn &txn);
+
+    /**
+     * Hold back a transaction issued on a thread of the bridge while the master is out of credits; waiting there
+     * would keep the responses returning the credits from being received
+     */
+    void park(Txn &txn);
+
+    /**
+     * Send the parked transactions for which there are credits
+     *
+     * @param haveRoom whether the room of a completed transaction has been kept for the first of them
+     */
+    void issueParked(bool haveRoom);
+
+    /**
+     * Keep the failure of a posted write for the next fence
+     */
+    void failPosted(const Status &status);
+
+    /**
+     * Complete the fence in progress, if any
+     */
+    void completeFence(const Status &status);
+
+    /**
+     * Cancel the fence in progress, if any, and have the following ones fail right away
+     */
+    void cancelFences();
+
+    /**
+     * Where the transactions of a channel go; the reads and the writes share it unless the bridge splits them
+     */
+    struct Channel {
+        Queue<Txn> *queue;
+        unsigned lane;  //!< Lane of the master in the writer draining the queue
     };
 
-    Master(uint64_t id, Queue<Txn> *queue) : id(id), queue(queue) {}
+    /**
+     * Queue the termination of the master behind everything it has issued on each channel
+     */
+    static void pushTermination(uint64_t id, const Channel &reads, const Channel &writes);
+
+    /**
+     * Queue the transaction on the channel; on the threads sending to and receiving from the router, a full queue is
+     * spilled over rather than waited for, since it may only drain once the thread has moved on
+     */
+    static void enqueue(const Channel &channel, Txn &txn);
+
+    Master(uint64_t id, Channel reads, Channel writes, const MasterConfig &config) :
+            id(id),
+            reads(reads),
+            writes(writes),
+            waitForCredits(config.waitForCredits),
+            qos(config.qos),
+            beatSize(config.beatSize),
+            postedWrites(config.postedWrites) {}
     uint64_t id;
-    Queue<Txn> *queue;
+    Channel reads;
+    Channel writes;
+    bool waitForCredits;
+    uint8_t qos;
+    unsigned beatSize;
+    bool postedWrites;
+    SlotRing<Txn> outstanding;  //!< Transactions waiting for their responses
+    std::mutex parkedMutex;
+    std::deque<Txn> parked;  //!< Transactions waiting for credits; guarded by parkedMutex
+    std::atomic<size_t> numParked{0};
+    CompletionQueue completions;
+    std::mutex fenceMutex;  //!< Held by the fence in progress
+    std::mutex postedMutex;
+    Status postedStatus;  //!< The first failure of a posted write since the last fence; guarded by postedMutex
+    std::promise<Status> *fenceDone = nullptr;  //!< Fulfilled by the FENCE_RESP; guarded by postedMutex
+    bool fencing = true;  //!< Whether a FENCE_RESP may still arrive; guarded by postedMutex
+};
+
+/**
+ * A piece of AXI4-Stream data: the TDATA of a run of beats with their TKEEP and TUSER, ending a packet if TLAST is
+ * set
+ */
+struct StreamPacket {
+    const uint8_t *data;  //!< TDATA of all the beats
+    uint64_t size;  //!< Size of the data in bytes
+    uint64_t dest;  //!< Address of the stream slave, standing for TDEST
+
+    /**
+     * TKEEP, one bit per byte of the data, LSB first; null if all the bytes are kept
+     */
+    const uint8_t *keep = nullptr;
+    uint64_t user = 0;  //!< TUSER
+    bool last = true;  //!< TLAST; false if the packet continues with the next piece
+};
+
+/**
+ * The interface for implementing software stream sinks
+ */
+class StreamSlave {
+public:
+    virtual ~StreamSlave() {}
+
+    /**
+     * Consume a piece of stream data, exactly as the stream master has sent it; the data is only valid for the
+     * duration of the call. Runs on the thread receiving the traffic, and the stream master gets its credits back
+     * when the call returns, so a slow consumer throttles the producer.
+     */
+    virtual void onPacket(const StreamPacket *packet) = 0;
+};
+
+/**
+ * The interface for producing AXI4-Stream data from software
+ *
+ * The data is sent in chunks straight from the memory of the caller, without waiting for any response. Each chunk
+ * in flight uses one of the credits negotiated with the router; a chunk is in flight until the stream slave has
+ * consumed it, so `send` waits for credits when the slave falls behind.
+ */
+class StreamMaster {
+    friend class Bridge;
+
+public:
+    static const uint64_t CHUNK_SIZE = 64 * 1024;  //!< Largest chunk a piece is split into
+
+    /**
+     * Send a piece of stream data
+     *
+     * The caller must keep the data valid and unchanged until the returned future is ready, which it becomes once
+     * the data has been written to the transport.
+     */
+    std::future<Status> send(const StreamPacket *packet);
+
+    /**
+     * Terminate the stream master; no further operation will be allowed
+     */
+    void terminate();
+
+private:
+    StreamMaster(uint64_t id, Master::Channel reads, Master::Channel writes, uint32_t credits) :
+            id(id), reads(reads), writes(writes), credits(credits) {}
+    void takeCredit();
+    void returnCredits(uint32_t count);
+
+    uint64_t id;
+    Master::Channel reads;  //!< Only carries the termination
+    Master::Channel writes;
+    std::mutex mutex;
+    std::condition_variable condVar;
+    uint32_t credits;  //!< Chunks that may still be sent
 };
 
 class RouterClient;
+class StreamView;
+
+/**
+ * Tuning parameters of a bridge
+ */
+struct BridgeConfig {
+    /**
+     * Number of threads handling the requests directed at the software slaves; with 0, the requests are handled on
+     * the thread receiving them, which stalls all the other traffic while a slave is busy
+     */
+    unsigned numSlaveWorkers = 0;
+
+    /**
+     * How long, in microseconds, the threads receiving from the router and sending to it spin on the transport and
+     * on the submission queue before they sleep; brings the round trip of a single access down to a few
+     * microseconds at the cost of keeping two cores busy, so it is only worth it when the cores are dedicated; 0
+     * disables busy polling
+     */
+    unsigned busyPollMicros = 0;
+
+    /**
+     * CPUs and scheduling of the thread receiving from the router; when pinned, the thread also moves the receive
+     * buffers to its NUMA node
+     */
+    ThreadPlacement readerPlacement;
+
+    /**
+     * CPUs and scheduling of the thread sending to the router; when pinned, the thread also moves the submission
+     * queue to its NUMA node
+     */
+    ThreadPlacement writerPlacement;
+
+    ThreadPlacement workerPlacement;  //!< CPUs and scheduling of the slave workers
+
+    /**
+     * How the writer shares the link between the lanes of the masters and the lane of the responses of the slaves;
+     * the responses have a weight of 1 and the QoS of their requests
+     */
+    Arbitration arbitration = Arbitration::WEIGHTED_ROUND_ROBIN;
+
+    /**
+     * Number of connections to the router carrying the transactions, each served by a reader and a writer thread
+     * of its own; the traffic of an IP block always goes over the connection given by its ID modulo this number,
+     * so the IP blocks spread over the connections do not hold each other back. Only the unix:// transport supports
+     * more than one.
+     */
+    unsigned numConnections = 1;
+
+    /**
+     * Carry the reads and the writes over connections of their own, with their own queues and threads, so that a
+     * large write does not hold back a short read issued after it; the transactions are then only kept in order
+     * within each channel, as on AXI. The router only routes the channels independently when all its clients split
+     * them, and keeps all the traffic in order otherwise. Doubles the number of connections, so it needs the unix://
+     * transport.
+     */
+    bool splitChannels = false;
+};
 
 /**
  * Bridge is the software entry point of the infrastructure.
@@ -118,14 +579,19 @@ class RouterClient;
  */
 class Bridge {
 public:
-    Bridge(const std::string &name = "unnamed");
+    /**
+     * Gets the interrupt line and the number of raises coalesced into its delivery
+     */
+    typedef std::function<void(uint32_t number, uint32_t raises)> InterruptCallback;
+
+    Bridge(const std::string &name = "unnamed", const BridgeConfig &config = BridgeConfig());
     ~Bridge();
 
     /**
      * Connect to the router
      *
-     * @param uri an URI pointing to a rendez-vous point with the router; currently only UNIX domain sockets are
-     *            supported
+     * @param uri an URI pointing to a rendez-vous point with the router; either `unix://path` for a UNIX domain
+     *            socket or `shm://path` for shared memory rings set up over the socket at path
      */
     Status connect(std::string uri = "unix:///tmp/sw-axi");
 
@@ -144,7 +610,21 @@ public:
     /**
      * Registers a master. The bridge owns the object.
      */
-    std::pair<Master *, Status> registerMaster(const std::string &name);
+    std::pair<Master *, Status> registerMaster(const std::string &name, const MasterConfig &config = MasterConfig());
+
+    /**
+     * Register a software stream slave with the given parameters; the type of the IP has to be SLAVE_STREAM and the
+     * stream masters reach the slave at its address. The bridge takes the ownership of the slave object.
+     */
+    Status registerStreamSlave(StreamSlave *slave, const IpConfig &config);
+
+    /**
+     * Register a stream master; it may have as many chunks in flight as it asks for with maxOutstanding, up to the
+     * limit of the router. The bridge owns the object.
+     */
+    std::pair<StreamMaster *, Status> registerStreamMaster(
+            const std::string &name,
+            const MasterConfig &config = MasterConfig());
 
     /**
      * Confirm that all IP has been registered.
@@ -155,9 +635,35 @@ public:
 
     /**
      * Start the bridge and make it handle the transaction traffic.
+     *
+     * Fails if the threads cannot be placed as the configuration asks, in which case no traffic is handled; a real
+     * time priority typically requires the CAP_SYS_NICE capability or a suitable RLIMIT_RTPRIO.
      */
     Status start();
 
+    /**
+     * Raise one of the interrupt lines allocated to the IP blocks registered by the bridge; the router delivers it
+     * to the other clients, and the waiters and callbacks of this bridge get it right away on the calling thread
+     */
+    Status raiseInterrupt(uint32_t number);
+
+    /**
+     * Wait until the interrupt line is delivered; the deliveries since the previous wait are consumed at once, so a
+     * driver polling a status register after each wake up does not miss any
+     *
+     * @param timeoutMicros how long to wait at most; 0 waits until the bridge stops receiving
+     * @return the number of raises consumed; ETIMEDOUT if the line has not been raised in time and ECANCELED if
+     *         the bridge has stopped receiving
+     */
+    std::pair<uint32_t, Status> waitInterrupt(uint32_t number, uint64_t timeoutMicros = 0);
+
+    /**
+     * Have the callback called each time the interrupt line is delivered, on the thread receiving from the router;
+     * replaces the previous callback of the line and an empty callback removes it. The deliveries still count for
+     * `waitInterrupt`.
+     */
+    void onInterrupt(uint32_t number, InterruptCallback callback);
+
     /**
      * Wait for the processing to finish
      */
@@ -183,30 +689,124 @@ public:
     void disconnect();
 
 private:
-    struct MasterMd {
-        Master *master = nullptr;
-        std::map<uint64_t, Master::Txn> txns;
-        uint64_t lastTxnId = 0;
+    /**
+     * A connection to the router together with the threads serving it; the first one is the control connection
+     */
+    struct Connection {
+        explicit Connection(Arbitration arbitration);
+        ~Connection();
+        std::unique_ptr<RouterClient> client;
+        Queue<Master::Txn> queue;
+        Arbiter<Master::Txn> lanes;  //!< Owned by the writer once the bridge has started
+        std::thread readerThread;
+        std::thread writerThread;
+        Status readerStatus;
+        Status writerStatus;
+
+        /**
+         * The strands of the slave workers that have received posted writes since the last fence, by master; only
+         * touched by the reader
+         */
+        std::map<uint64_t, std::set<uint64_t>> postedStrands;
     };
 
-    void reader();
-    void writer();
-    static void startReader(Bridge *b);
-    static void startWriter(Bridge *b);
+    /**
+     * The connection carrying the transactions of the given type of the IP block; with split channels, the reads
+     * of stripe n go over connection n and its writes over connection numStripes + n
+     */
+    Connection &connectionFor(uint64_t ip, TransactionType type) {
+        uint64_t index = ip % numStripes;
+        if (config.splitChannels && (type == TransactionType::WRITE_REQ || type == TransactionType::WRITE_RESP)) {
+            index += numStripes;
+        }
+        return *connections[index];
+    }
+
+    void reader(Connection &conn);
+    Status dispatch(Connection &conn);
+    void writer(Connection &conn);
+    Status send(RouterClient &client, Master::Txn &txn, bool flush);
+
+    /**
+     * Have the slave handle the request and queue the response
+     */
+    void serve(Slave *slave, const Transaction &req, const uint8_t *payload);
+
+    /**
+     * Complete the response to the request and queue it, unless it is the success of a posted write
+     */
+    void respond(const Transaction &req, Transaction *respTxn);
 
-    RouterClient *client;
+    /**
+     * Deliver the stream data to its slave or the credits to their master
+     */
+    Status receiveStream(const StreamView &view);
+
+    /**
+     * Complete the fence of a master, or answer the fence once the posted writes received before it have been
+     * handled; the answer is queued behind them on their strands rather than waited for
+     */
+    Status receiveFence(Connection &conn, uint64_t master, bool response);
+
+    /**
+     * Hand the interrupt over to its callback and wake up its waiters
+     */
+    void deliverInterrupt(uint32_t number, uint32_t raises);
+
+    /**
+     * Find the buffer of the outstanding read request the response payload belongs to
+     */
+    uint8_t *readSink(uint64_t initiator, uint64_t id, size_t size);
+    static void startReader(Bridge *b, Connection *conn, std::shared_future<bool> placed);
+    static void startWriter(Bridge *b, Connection *conn, std::shared_future<bool> placed);
+
+    std::vector<std::unique_ptr<Connection>> connections;
+    unsigned numStripes;
+    RouterClient *client;  //!< The client of the control connection
     std::unique_ptr<SystemInfo> routerInfo;
     std::vector<SystemInfo> peers;
     std::vector<IpConfig> ipBlocks;
     std::map<uint64_t, Slave *> slaveMap;
-    std::map<uint64_t, MasterMd> masterMap;
+    std::map<uint64_t, Master *> masterMap;  //!< Read-only once the bridge has started
+
+    /**
+     * A stream slave with the pieces it is receiving, by stream master; only touched by the reader of the
+     * connection of the slave
+     */
+    struct StreamSink {
+        StreamSlave *slave;
+        struct Piece {
+            std::vector<uint8_t> data;
+            std::vector<uint8_t> keep;
+            uint32_t chunks = 0;
+        };
+        std::map<uint64_t, Piece> pieces;
+    };
+
+    std::map<uint64_t, StreamSink> streamSlaveMap;  //!< The map itself is read-only once the bridge has started
+    std::map<uint64_t, StreamMaster *> streamMasterMap;  //!< Read-only once the bridge has started
+
+    /**
+     * The raises of an interrupt line that no waiter has consumed yet and the callback of the line
+     */
+    struct InterruptLine {
+        uint32_t pending = 0;
+        InterruptCallback callback;
+    };
+
+    std::vector<std::pair<uint32_t, uint32_t>> interruptRanges;  //!< Lines allocated to the IP blocks, [first, last)
+    std::mutex interruptMutex;
+    std::condition_variable interruptCondVar;
+    std::map<uint32_t, InterruptLine> interruptLines;  //!< Guarded by interruptMutex
+    bool receiving = true;  //!< Whether interrupts may still arrive; guarded by interruptMutex
     std::string name;
-    Queue<Master::Txn> queue;
-    std::thread readerThread;
-    std::thread writerThread;
-    Status readerStatus;
-    Status writerStatus;
-    std::mutex masterMapMutex;
+    BridgeConfig config;
+    WorkerPool slaveWorkers;
+    std::atomic<unsigned> activeReaders{0};
 };
 
 }  // namespace sw_axi
+
+#ifdef __cpp_impl_coroutine
+#include "Coroutine.hh"
+#endif
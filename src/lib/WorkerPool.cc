@@ -0,0 +1,119 @@
+//------------------------------------------------------------------------------
+// Copyright (C) 2020 Daedalean AG
+//
+// This file is part of SW-AXI.
+//
+// SW-AXI is free software: you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+//
+// SW-AXI is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with SW-AXI.  If not, see <https://www.gnu.org/licenses/>.
+//------------------------------------------------------------------------------
+
+#include "WorkerPool.hh"
+
+namespace sw_axi {
+
+WorkerPool::~WorkerPool() {
+    stop();
+}
+
+Status WorkerPool::start(unsigned numWorkers, const ThreadPlacement &placement) {
+    stopping = false;
+    Status status;
+    for (unsigned i = 0; i < numWorkers; ++i) {
+        workers.emplace_back([this]() { work(); });
+        Status st = placeThread(workers.back().native_handle(), placement);
+        if (st.isError()) {
+            status = st;
+        }
+    }
+    return status;
+}
+
+void WorkerPool::post(Job job) {
+    {
+        std::lock_guard<std::mutex> scopedLock(mutex);
+        ready.push_back(std::move(job));
+    }
+    condVar.notify_one();
+}
+
+void WorkerPool::post(uint64_t strand, Job job) {
+    {
+        std::lock_guard<std::mutex> scopedLock(mutex);
+        Strand &s = strands[strand];
+        s.jobs.push_back(std::move(job));
+        if (s.scheduled) {
+            return;
+        }
+        s.scheduled = true;
+        ready.push_back([this, strand]() { runStrand(strand); });
+    }
+    condVar.notify_one();
+}
+
+void WorkerPool::stop() {
+    {
+        std::lock_guard<std::mutex> scopedLock(mutex);
+        stopping = true;
+    }
+    condVar.notify_all();
+
+    for (auto &worker : workers) {
+        worker.join();
+    }
+    workers.clear();
+}
+
+void WorkerPool::work() {
+    while (true) {
+        Job job;
+        {
+            std::unique_lock<std::mutex> scopedLock(mutex);
+            while (ready.empty() && !stopping) {
+                condVar.wait(scopedLock);
+            }
+            if (ready.empty()) {
+                return;
+            }
+            job = std::move(ready.front());
+            ready.pop_front();
+        }
+        job();
+    }
+}
+
+void WorkerPool::runStrand(uint64_t strand) {
+    Job job;
+    {
+        std::lock_guard<std::mutex> scopedLock(mutex);
+        Strand &s = strands[strand];
+        job = std::move(s.jobs.front());
+        s.jobs.pop_front();
+    }
+
+    job();
+
+    // The strand goes to the back of the ready queue after each job, so that a busy strand does not starve the
+    // others; a strand that has run dry is dropped, since the keys may come from an open set such as AXI IDs
+    {
+        std::lock_guard<std::mutex> scopedLock(mutex);
+        auto it = strands.find(strand);
+        if (it->second.jobs.empty()) {
+            strands.erase(it);
+            return;
+        }
+        ready.push_back([this, strand]() { runStrand(strand); });
+    }
+    condVar.notify_one();
+}
+
+}  // namespace sw_axi
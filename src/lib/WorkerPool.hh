@@ -0,0 +1,95 @@
+//------------------------------------------------------------------------------
+// Copyright (C) 2020 Daedalean AG
+//
+// This file is part of SW-AXI.
+//
+// SW-AXI is free software: you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+//
+// SW-AXI is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with SW-AXI.  If not, see <https://www.gnu.org/licenses/>.
+//------------------------------------------------------------------------------
+
+#pragma once
+
+#include "../common/Placement.hh"
+
+#include <condition_variable>
+#include <cstdint>
+#include <deque>
+#include <functional>
+#include <mutex>
+#include <thread>
+#include <unordered_map>
+#include <vector>
+
+namespace sw_axi {
+
+/**
+ * A fixed set of threads running jobs
+ *
+ * A job is either run by whichever worker is free or bound to a strand; the jobs of a strand run one at a time in
+ * the order in which they have been posted, while different strands run concurrently.
+ */
+class WorkerPool {
+public:
+    typedef std::function<void()> Job;
+
+    WorkerPool() {}
+    ~WorkerPool();
+    WorkerPool(const WorkerPool &) = delete;
+    WorkerPool &operator=(const WorkerPool &) = delete;
+
+    /**
+     * Start the given number of workers and place them as requested; the workers that could not be placed keep
+     * running where the system puts them
+     */
+    Status start(unsigned numWorkers, const ThreadPlacement &placement = ThreadPlacement());
+
+    /**
+     * Tell whether the workers are running
+     */
+    bool isRunning() const {
+        return !workers.empty();
+    }
+
+    /**
+     * Run the job on any worker
+     */
+    void post(Job job);
+
+    /**
+     * Run the job after all the jobs posted to the same strand before
+     */
+    void post(uint64_t strand, Job job);
+
+    /**
+     * Run all the jobs that have been posted and stop the workers
+     */
+    void stop();
+
+private:
+    struct Strand {
+        std::deque<Job> jobs;
+        bool scheduled = false;  //!< A turn of the strand is waiting in the ready queue or running
+    };
+
+    void work();
+    void runStrand(uint64_t strand);
+
+    std::vector<std::thread> workers;
+    std::deque<Job> ready;
+    std::unordered_map<uint64_t, Strand> strands;
+    std::mutex mutex;
+    std::condition_variable condVar;
+    bool stopping = false;
+};
+
+}  // namespace sw_axi
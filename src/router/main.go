@@ -35,6 +35,8 @@ func main() {
 	logLevel := flag.String("log-level", "Info", "verbosity of the diagnostic information")
 	numClients := flag.Int("n", 2, "number of clients")
 	uri := flag.String("uri", "unix:///tmp/sw-axi", "the rendez-vous point")
+	irqCount := flag.Uint("irq-coalesce-count", 0, "raises delivering a coalesced interrupt right away; 0 for no limit")
+	irqDelay := flag.Duration("irq-coalesce-delay", 0, "longest time an interrupt is held back; 0 for no coalescing")
 
 	flag.Parse()
 
@@ -72,6 +74,13 @@ func main() {
 		log.Fatalf("Can't create a router: %s", err)
 	}
 
+	if err := router.SetInterruptCoalescing(uint32(*irqCount), *irqDelay); err != nil {
+		log.Fatalf("Can't coalesce interrupts: %s", err)
+	}
+	if *irqDelay != 0 {
+		log.Infof("Interrupt coalescing: %d raises or %s", *irqCount, *irqDelay)
+	}
+
 	if err := router.Run(); err != nil {
 		log.Fatalf("Can't run a listener: %s", err)
 	}
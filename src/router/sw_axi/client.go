@@ -20,7 +20,7 @@
 package sw_axi
 
 import (
-	"bytes"
+	"bufio"
 	"encoding/binary"
 	"fmt"
 	"io"
@@ -35,42 +35,99 @@ import (
 	"router/sw_axi/wire"
 )
 
+const (
+	ioBufferSize = 64 * 1024 // Size of the socket read and write buffers
+	queueLength  = 256       // Number of messages that can wait for a writer or for the router
+)
+
 type client struct {
 	Id         uint64
 	SystemInfo SystemInfo
 	wg         *sync.WaitGroup
 	conn       net.Conn
+	rd         io.Reader
+	wr         *bufio.Writer
+	shm        *shmChannel
 	outgoing   chan []byte
-	incoming   chan []byte
+	incoming   chan []byte // Input of the route fed by the connection
+	numStripes uint32      // Number of stripes announced by the client
+	split      bool        // Whether the reads and the writes of each stripe have connections of their own
+	conns      []*client   // Connections of the client; the first one is the control connection
+	hasMasters bool        // Whether the client has registered masters, running the drivers that get the interrupts
+}
+
+// Number of connections the client uses, the control connection included
+func (c *client) numConns() int {
+	if c.split {
+		return int(c.numStripes) * numChannels
+	}
+	return int(c.numStripes)
+}
+
+// The connection carrying the traffic of the IP block on the given channel; the IP blocks are spread over the
+// stripes by ID and, with split channels, the writes of stripe n go over connection numStripes + n
+func (c *client) connFor(ip uint64, channel int) *client {
+	index := ip % uint64(c.numStripes)
+	if c.split && channel == writeChannel {
+		index += uint64(c.numStripes)
+	}
+	return c.conns[index]
 }
 
 func (c *client) readMsg() ([]byte, error) {
+	if c.shm != nil {
+		return c.shm.rx.read()
+	}
+
 	sizeArr := make([]byte, 8)
-	if _, err := io.ReadFull(c.conn, sizeArr); err != nil {
+	if _, err := io.ReadFull(c.rd, sizeArr); err != nil {
 		return nil, fmt.Errorf("Unable to read message size: %s", err)
 	}
 	size := binary.LittleEndian.Uint64(sizeArr)
 
 	msg := make([]byte, size)
-	if _, err := io.ReadFull(c.conn, msg); err != nil {
+	if _, err := io.ReadFull(c.rd, msg); err != nil {
 		return nil, fmt.Errorf("Unable to read message: %s", err)
 	}
 	return msg, nil
 }
 
-func (c *client) writeMsg(msg []byte) error {
+// Put the message in the write buffer; it goes out with the next flush or when the buffer fills up
+func (c *client) queueMsg(msg []byte) error {
+	if c.shm != nil {
+		return c.shm.tx.write(msg)
+	}
+
 	sizeArr := make([]byte, 8)
 	binary.LittleEndian.PutUint64(sizeArr, uint64(len(msg)))
-	if _, err := io.Copy(c.conn, bytes.NewReader(sizeArr)); err != nil {
+	if _, err := c.wr.Write(sizeArr); err != nil {
 		return fmt.Errorf("Unable to write message size: %s", err)
 	}
 
-	if _, err := io.Copy(c.conn, bytes.NewReader(msg)); err != nil {
+	if _, err := c.wr.Write(msg); err != nil {
 		return fmt.Errorf("Unable to write message: %s", err)
 	}
 	return nil
 }
 
+func (c *client) flush() error {
+	if c.shm != nil {
+		return nil
+	}
+
+	if err := c.wr.Flush(); err != nil {
+		return fmt.Errorf("Unable to write message: %s", err)
+	}
+	return nil
+}
+
+func (c *client) writeMsg(msg []byte) error {
+	if err := c.queueMsg(msg); err != nil {
+		return err
+	}
+	return c.flush()
+}
+
 func (c *client) shakeHands() error {
 	msgArr, err := c.readMsg()
 	if err != nil {
@@ -83,7 +140,23 @@ func (c *client) shakeHands() error {
 	}
 
 	si := msg.SystemInfo(nil)
-	c.SystemInfo = SystemInfo{string(si.Name()), string(si.SystemName()), string(si.Hostname()), si.Pid()}
+	c.SystemInfo = SystemInfo{string(si.Name()), string(si.SystemName()), string(si.Hostname()), si.Pid(),
+		si.Encodings()}
+	c.numStripes = 1
+	if si.Stripes() > 1 {
+		c.numStripes = si.Stripes()
+	}
+	c.split = si.SplitChannels()
+	if c.numConns() > 1 && si.ShmSize() != 0 {
+		return fmt.Errorf("Only the socket transport can use multiple data connections")
+	}
+
+	var shm *shmChannel
+	if si.ShmSize() != 0 {
+		if shm, err = attachShm(c.conn, si.ShmSize()); err != nil {
+			return err
+		}
+	}
 
 	hn, err := os.Hostname()
 	if err != nil {
@@ -100,15 +173,28 @@ func (c *client) shakeHands() error {
 	wire.SystemInfoAddSystemName(builder, sysName)
 	wire.SystemInfoAddHostname(builder, hName)
 	wire.SystemInfoAddPid(builder, uint64(os.Getpid()))
+	if shm != nil {
+		wire.SystemInfoAddShmSize(builder, shm.rx.capacity)
+	}
 	mySi := wire.SystemInfoEnd(builder)
 
 	wire.MessageStart(builder)
 	wire.MessageAddType(builder, wire.TypeSYSTEM_INFO)
 	wire.MessageAddSystemInfo(builder, mySi)
+	wire.MessageAddClientId(builder, c.Id)
 	builder.Finish(wire.MessageEnd(builder))
 
+	// The reply still goes over the socket, everything that follows goes over the rings
 	rsp := builder.FinishedBytes()
-	return c.writeMsg(rsp)
+	if err := c.writeMsg(rsp); err != nil {
+		return err
+	}
+	c.shm = shm
+
+	// Nothing has been read ahead up to this point, so that the descriptor of the shared memory segment could not
+	// get lost in a buffered read
+	c.rd = bufio.NewReaderSize(c.conn, ioBufferSize)
+	return nil
 }
 
 func (c *client) receiveIpInfo() (*IpInfo, error) {
@@ -158,17 +244,19 @@ func (c *client) receiveIpInfo() (*IpInfo, error) {
 			ii.NumInterrupts(),
 			typ,
 			impl,
+			ii.MaxOutstanding(),
 			0,
 			c.Id,
 		},
 		nil
 }
 
-func (c *client) ackIpInfo(id uint64) error {
+func (c *client) ackIpInfo(id uint64, credits uint32) error {
 	builder := flatbuffers.NewBuilder(0)
 	wire.MessageStart(builder)
 	wire.MessageAddType(builder, wire.TypeIP_ACK)
 	wire.MessageAddIpId(builder, id)
+	wire.MessageAddCredits(builder, credits)
 	builder.Finish(wire.MessageEnd(builder))
 	return c.writeMsg(builder.FinishedBytes())
 }
@@ -203,6 +291,7 @@ func (c *client) commit(clients []SystemInfo, ips []*IpInfo) error {
 		wire.SystemInfoAddSystemName(builder, sysName)
 		wire.SystemInfoAddHostname(builder, hName)
 		wire.SystemInfoAddPid(builder, cl.Pid)
+		wire.SystemInfoAddEncodings(builder, cl.Encodings)
 		si := wire.SystemInfoEnd(builder)
 
 		wire.MessageStart(builder)
@@ -275,18 +364,35 @@ func (c *client) commit(clients []SystemInfo, ips []*IpInfo) error {
 	return c.ack()
 }
 
+// Queue a message for the client and tell whether it was the last one
+func (c *client) send(msgArr []byte) bool {
+	if err := c.queueMsg(msgArr); err != nil {
+		log.Fatalf("Cannot write message to client %s: %s", c.SystemInfo.Name, err)
+	}
+
+	msg := wire.GetRootAsMessage(msgArr, 0)
+	log.Debugf("[%20s] Sent a message of type %s", c.SystemInfo.Name, wire.EnumNamesType[msg.Type()])
+	return msg.Type() == wire.TypeDONE
+}
+
 func (c *client) writer() {
-	for {
+	for done := false; !done; {
 		msgArr := <-c.outgoing
-		err := c.writeMsg(msgArr)
-		if err != nil {
-			log.Fatalf("Cannot write message to client %s: %s", c.SystemInfo.Name, err)
+
+		// Take everything that is already waiting before paying for the system call
+		for pending := true; pending; {
+			if done = c.send(msgArr); done {
+				break
+			}
+			select {
+			case msgArr = <-c.outgoing:
+			default:
+				pending = false
+			}
 		}
 
-		msg := wire.GetRootAsMessage(msgArr, 0)
-		log.Debugf("[%20s] Sent a message of type %s", c.SystemInfo.Name, wire.EnumNamesType[msg.Type()])
-		if msg.Type() == wire.TypeDONE {
-			break
+		if err := c.flush(); err != nil {
+			log.Fatalf("Cannot write message to client %s: %s", c.SystemInfo.Name, err)
 		}
 	}
 	c.wg.Done()
@@ -311,16 +417,23 @@ func (c *client) reader() {
 }
 
 func (c *client) close() {
+	for _, s := range c.conns[1:] {
+		s.conn.Close()
+	}
 	c.conn.Close()
 	log.Infof("[%20s] Logged out", c.SystemInfo.Name)
 }
 
-func newClient(id int, conn net.Conn, incoming chan []byte, wg *sync.WaitGroup) *client {
+func newClient(id int, conn net.Conn, wg *sync.WaitGroup) *client {
 	c := new(client)
+	c.Id = uint64(id)
 	c.conn = conn
+	c.rd = conn
+	c.wr = bufio.NewWriterSize(conn, ioBufferSize)
 	c.wg = wg
 	c.SystemInfo.Name = "unknown"
-	c.outgoing = make(chan []byte)
-	c.incoming = incoming
+	c.outgoing = make(chan []byte, queueLength)
+	c.numStripes = 1
+	c.conns = []*client{c}
 	return c
 }
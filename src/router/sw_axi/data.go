@@ -50,6 +50,7 @@ type SystemInfo struct {
 	SystemName string
 	Hostname   string
 	Pid        uint64
+	Encodings  uint32
 }
 
 func (si SystemInfo) String() string {
@@ -67,6 +68,7 @@ type IpInfo struct {
 	NumInterrupts  uint16
 	Type           IpType
 	Implementation IpImplementation
+	MaxOutstanding uint32
 	Id             uint64
 	ClientId       uint64
 }
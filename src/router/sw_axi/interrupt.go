@@ -0,0 +1,149 @@
+//------------------------------------------------------------------------------
+// Copyright (C) 2020 Daedalean AG
+//
+// This file is part of SW-AXI.
+//
+// SW-AXI is free software: you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+//
+// SW-AXI is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with SW-AXI.  If not, see <https://www.gnu.org/licenses/>.
+//------------------------------------------------------------------------------
+
+package sw_axi
+
+import (
+	"fmt"
+	"time"
+
+	flatbuffers "github.com/google/flatbuffers/go"
+	log "github.com/sirupsen/logrus"
+	"router/sw_axi/wire"
+)
+
+// Raises of the same interrupt line that are held back to be delivered together; a pending interrupt is delivered
+// once it has been raised a given number of times or once the oldest pending raise is a given time old, whichever
+// comes first, so that an interrupt storm does not flood the software
+type interruptCoalescer struct {
+	count   uint32            // Raises delivering an interrupt right away; 0 for no coalescing by count
+	delay   time.Duration     // Longest time a raise stays pending; 0 if interrupts are not coalesced
+	pending map[uint32]uint32 // Pending raises by interrupt number
+	timer   *time.Timer       // Armed at the first raise held back since the last flush
+}
+
+// Record a raise of the interrupt; return the number of raises to deliver right away or 0 if it is held back
+func (c *interruptCoalescer) raise(number uint32) uint32 {
+	if c.delay == 0 {
+		return 1
+	}
+
+	if c.pending == nil {
+		c.pending = make(map[uint32]uint32)
+	}
+	raises := c.pending[number] + 1
+	if c.count != 0 && raises >= c.count {
+		delete(c.pending, number)
+		return raises
+	}
+
+	c.pending[number] = raises
+	if c.timer == nil {
+		c.timer = time.NewTimer(c.delay)
+	}
+	return 0
+}
+
+// The channel firing when the held back raises are due; nil if none is held back
+func (c *interruptCoalescer) expired() <-chan time.Time {
+	if c.timer == nil {
+		return nil
+	}
+	return c.timer.C
+}
+
+// Take all the held back raises by interrupt number
+func (c *interruptCoalescer) flush() map[uint32]uint32 {
+	if c.timer != nil {
+		c.timer.Stop()
+		c.timer = nil
+	}
+	pending := c.pending
+	c.pending = nil
+	return pending
+}
+
+// Coalesce the raises of each interrupt line: a raise is held back for at most the given delay and an interrupt is
+// delivered right away once it has been raised count times; a zero delay disables coalescing
+func (r *Router) SetInterruptCoalescing(count uint32, delay time.Duration) error {
+	if delay < 0 {
+		return fmt.Errorf("The interrupt coalescing delay cannot be negative")
+	}
+	if count > 1 && delay == 0 {
+		return fmt.Errorf("Coalescing interrupts by count needs a delay bounding how long they are held back")
+	}
+	r.interrupts.count = count
+	r.interrupts.delay = delay
+	return nil
+}
+
+func createInterruptMessage(number, raises uint32) []byte {
+	builder := flatbuffers.NewBuilder(0)
+	wire.MessageStart(builder)
+	wire.MessageAddType(builder, wire.TypeINTERRUPT)
+	wire.MessageAddInterrupt(builder, number)
+	wire.MessageAddRaises(builder, raises)
+	builder.Finish(wire.MessageEnd(builder))
+	return builder.FinishedBytes()
+}
+
+// Return the IP block that the interrupt line has been allocated to
+func (r *Router) findInterruptOwner(number uint32) (*IpInfo, error) {
+	for _, ip := range r.ips {
+		if number >= uint32(ip.FirstInterrupt) && number < uint32(ip.FirstInterrupt)+uint32(ip.NumInterrupts) {
+			return ip, nil
+		}
+	}
+	return nil, fmt.Errorf("No IP block has interrupt %d", number)
+}
+
+// Send the interrupt over the control connections of the clients that have masters, and so may run drivers, apart
+// from the client owning the IP block that has raised it
+func (r *Router) deliverInterrupt(number, raises uint32) {
+	owner, err := r.findInterruptOwner(number)
+	if err != nil {
+		return
+	}
+
+	log.Debugf("Delivering interrupt %d of %s [%d raises]", number, owner.Name, raises)
+	msgArr := createInterruptMessage(number, raises)
+	for _, ch := range r.clients {
+		if ch.hasMasters && ch.Id != owner.ClientId {
+			ch.outgoing <- msgArr
+		}
+	}
+}
+
+// Deliver the interrupt or hold it back to be coalesced with the following raises
+func (r *Router) routeInterrupt(msg *wire.Message) {
+	if _, err := r.findInterruptOwner(msg.Interrupt()); err != nil {
+		log.Errorf("Dropping interrupt: %s", err)
+		return
+	}
+	if raises := r.interrupts.raise(msg.Interrupt()); raises != 0 {
+		r.deliverInterrupt(msg.Interrupt(), raises)
+	}
+}
+
+// Deliver all the raises held back
+func (r *Router) flushInterrupts() {
+	for number, raises := range r.interrupts.flush() {
+		r.deliverInterrupt(number, raises)
+	}
+}
@@ -0,0 +1,189 @@
+//------------------------------------------------------------------------------
+// Copyright (C) 2020 Daedalean AG
+//
+// This file is part of SW-AXI.
+//
+// SW-AXI is free software: you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+//
+// SW-AXI is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with SW-AXI.  If not, see <https://www.gnu.org/licenses/>.
+//------------------------------------------------------------------------------
+
+package sw_axi
+
+import (
+	"testing"
+	"time"
+
+	"router/sw_axi/wire"
+)
+
+// A router with three clients that never connected: the first one owns a slave with interrupts 4 to 7 and has a
+// master, the second one only has a master and the third one only has a slave
+func newInterruptRouter(t *testing.T) *Router {
+	r, err := NewRouter("unix:///tmp/sw-axi-test", 3)
+	if err != nil {
+		t.Fatal(err)
+	}
+	for i := 0; i < 3; i++ {
+		r.clients = append(r.clients, &client{Id: uint64(i), outgoing: make(chan []byte, queueLength)})
+	}
+
+	ips := []*IpInfo{
+		{Name: "irq-slave", Address: 0x1000, Size: 0x1000, FirstInterrupt: 4, NumInterrupts: 4, Type: SLAVE,
+			ClientId: 0},
+		{Name: "owner-master", Type: MASTER, ClientId: 0},
+		{Name: "driver-master", Type: MASTER, ClientId: 1},
+		{Name: "quiet-slave", Address: 0x2000, Size: 0x1000, Type: SLAVE, ClientId: 2},
+	}
+	for _, ip := range ips {
+		if _, err := r.registerIp(ip); err != nil {
+			t.Fatal(err)
+		}
+	}
+	return r
+}
+
+// Take the interrupts sent to the client so far
+func receivedInterrupts(t *testing.T, c *client) map[uint32]uint32 {
+	raises := make(map[uint32]uint32)
+	for {
+		select {
+		case msgArr := <-c.outgoing:
+			msg := wire.GetRootAsMessage(msgArr, 0)
+			if msg.Type() != wire.TypeINTERRUPT {
+				t.Fatalf("Client %d got a message of type %d instead of an interrupt", c.Id, msg.Type())
+			}
+			raises[msg.Interrupt()] += msg.Raises()
+		default:
+			return raises
+		}
+	}
+}
+
+func raiseInterrupt(r *Router, number uint32) {
+	r.routeInterrupt(wire.GetRootAsMessage(createInterruptMessage(number, 1), 0))
+}
+
+// Only the clients with masters get the interrupts, apart from the one owning the interrupt line
+func checkDelivered(t *testing.T, r *Router, expected map[uint32]uint32) {
+	got := receivedInterrupts(t, r.clients[1])
+	if len(got) != len(expected) {
+		t.Errorf("Delivered %v instead of %v", got, expected)
+	}
+	for number, raises := range expected {
+		if got[number] != raises {
+			t.Errorf("Delivered %d raises of interrupt %d instead of %d", got[number], number, raises)
+		}
+	}
+	for _, c := range []*client{r.clients[0], r.clients[2]} {
+		if got := receivedInterrupts(t, c); len(got) != 0 {
+			t.Errorf("Client %d got interrupts %v", c.Id, got)
+		}
+	}
+}
+
+func TestFindInterruptOwner(t *testing.T) {
+	r := newInterruptRouter(t)
+	for number := uint32(4); number < 8; number++ {
+		owner, err := r.findInterruptOwner(number)
+		if err != nil || owner.Name != "irq-slave" {
+			t.Errorf("Interrupt %d is owned by %v: %v", number, owner, err)
+		}
+	}
+	for _, number := range []uint32{0, 3, 8} {
+		if _, err := r.findInterruptOwner(number); err == nil {
+			t.Errorf("Interrupt %d has an owner", number)
+		}
+	}
+
+	overlapping := &IpInfo{Name: "overlapping", Address: 0x3000, Size: 0x1000, FirstInterrupt: 7, NumInterrupts: 2,
+		Type: SLAVE, ClientId: 2}
+	if _, err := r.registerIp(overlapping); err == nil {
+		t.Errorf("Registered an IP block with interrupts overlapping those of another one")
+	}
+}
+
+func TestRouteInterrupt(t *testing.T) {
+	r := newInterruptRouter(t)
+	raiseInterrupt(r, 5)
+	raiseInterrupt(r, 5)
+	raiseInterrupt(r, 7)
+	checkDelivered(t, r, map[uint32]uint32{5: 2, 7: 1})
+
+	// Nobody owns the line, so nobody gets the interrupt
+	raiseInterrupt(r, 42)
+	checkDelivered(t, r, map[uint32]uint32{})
+}
+
+func TestCoalesceInterruptsByCount(t *testing.T) {
+	r := newInterruptRouter(t)
+	if err := r.SetInterruptCoalescing(3, time.Hour); err != nil {
+		t.Fatal(err)
+	}
+
+	raiseInterrupt(r, 4)
+	raiseInterrupt(r, 4)
+	raiseInterrupt(r, 6)
+	checkDelivered(t, r, map[uint32]uint32{})
+	if r.interrupts.expired() == nil {
+		t.Errorf("No timer armed for the held back raises")
+	}
+
+	raiseInterrupt(r, 4)
+	checkDelivered(t, r, map[uint32]uint32{4: 3})
+
+	r.flushInterrupts()
+	checkDelivered(t, r, map[uint32]uint32{6: 1})
+	if r.interrupts.expired() != nil {
+		t.Errorf("The timer is still armed after the flush")
+	}
+}
+
+func TestCoalesceInterruptsByDelay(t *testing.T) {
+	r := newInterruptRouter(t)
+	if err := r.SetInterruptCoalescing(0, 10*time.Millisecond); err != nil {
+		t.Fatal(err)
+	}
+
+	for i := 0; i < 5; i++ {
+		raiseInterrupt(r, 5)
+	}
+	checkDelivered(t, r, map[uint32]uint32{})
+
+	select {
+	case <-r.interrupts.expired():
+	case <-time.After(10 * time.Second):
+		t.Fatal("The held back raises never became due")
+	}
+	r.flushInterrupts()
+	checkDelivered(t, r, map[uint32]uint32{5: 5})
+}
+
+func TestSetInterruptCoalescing(t *testing.T) {
+	r := newInterruptRouter(t)
+	if err := r.SetInterruptCoalescing(0, -time.Millisecond); err == nil {
+		t.Errorf("Accepted a negative delay")
+	}
+	if err := r.SetInterruptCoalescing(4, 0); err == nil {
+		t.Errorf("Accepted coalescing by count without a delay")
+	}
+
+	// Without a delay, every raise is delivered right away
+	if err := r.SetInterruptCoalescing(0, 0); err != nil {
+		t.Fatal(err)
+	}
+	raiseInterrupt(r, 6)
+	checkDelivered(t, r, map[uint32]uint32{6: 1})
+	if r.interrupts.expired() != nil {
+		t.Errorf("A timer is armed without coalescing")
+	}
+}
@@ -20,11 +20,15 @@
 package sw_axi
 
 import (
+	"bufio"
 	"fmt"
 	"net"
 	"os"
+	"sort"
 	"strings"
 	"sync"
+	"sync/atomic"
+	"time"
 
 	flatbuffers "github.com/google/flatbuffers/go"
 	log "github.com/sirupsen/logrus"
@@ -41,21 +45,25 @@ func createErrorMessage(err error) []byte {
 	return builder.FinishedBytes()
 }
 
-func createErrorTxn(initiator, id uint64, typ wire.TransactionType, err error) []byte {
+// Build the error response to the request; the response to a posted write is marked as such, so that the master
+// reports it at its next fence
+func createErrorTxn(req *wire.Transaction, err error) []byte {
 	builder := flatbuffers.NewBuilder(0)
 	msg := builder.CreateString(err.Error())
 
 	wire.TransactionStart(builder)
 
-	if typ == wire.TransactionTypeREAD_REQ {
+	if req.Type() == wire.TransactionTypeREAD_REQ {
 		wire.TransactionAddType(builder, wire.TransactionTypeREAD_RESP)
 	}
-	if typ == wire.TransactionTypeWRITE_REQ {
+	if req.Type() == wire.TransactionTypeWRITE_REQ {
 		wire.TransactionAddType(builder, wire.TransactionTypeWRITE_RESP)
 	}
 
-	wire.TransactionAddInitiator(builder, initiator)
-	wire.TransactionAddId(builder, id)
+	wire.TransactionAddInitiator(builder, req.Initiator())
+	wire.TransactionAddId(builder, req.Id())
+	wire.TransactionAddAxiId(builder, req.AxiId())
+	wire.TransactionAddPosted(builder, req.Posted())
 	wire.TransactionAddOk(builder, false)
 	wire.TransactionAddMessage(builder, msg)
 	txn := wire.TransactionEnd(builder)
@@ -67,21 +75,75 @@ func createErrorTxn(initiator, id uint64, typ wire.TransactionType, err error) [
 	return builder.FinishedBytes()
 }
 
+const (
+	defaultMasterCredits = 256
+	maxMasterCredits     = 1024
+)
+
+// When all the clients split their channels, the reads and the writes are routed independently of each other, as
+// the read and write channels of AXI are, and the transactions are only kept in order within each channel; otherwise
+// a single route takes all the traffic in order, since a slave's credits cannot be split between routes that the
+// clients keeping their channels together would both use
+const (
+	readChannel = iota
+	writeChannel
+	numChannels
+)
+
+func channelOf(typ wire.TransactionType) int {
+	if typ == wire.TransactionTypeWRITE_REQ || typ == wire.TransactionTypeWRITE_RESP {
+		return writeChannel
+	}
+	return readChannel
+}
+
+// Requests waiting for a slave that has as many transactions in flight as it can handle; ordered by decreasing
+// QoS and by arrival within the same QoS
+type slaveBacklog struct {
+	outstanding uint32
+	txns        []*wire.Transaction
+}
+
+// Queue the transaction behind all the held transactions of the same or higher QoS
+func (b *slaveBacklog) hold(txn *wire.Transaction) {
+	pos := sort.Search(len(b.txns), func(i int) bool { return b.txns[i].Qos() < txn.Qos() })
+	b.txns = append(b.txns, nil)
+	copy(b.txns[pos+1:], b.txns[pos:])
+	b.txns[pos] = txn
+}
+
 type Router struct {
-	uri         string
-	numClients  int
-	clients     []*client
-	ipCount     uint64
-	masterCount uint64
-	ipMMap      map[uint64]*IpInfo
-	ips         []*IpInfo
-	incoming    chan []byte
-	wg          sync.WaitGroup
+	uri          string
+	numClients   int
+	clients      []*client
+	ipCount      uint64
+	masterCount  uint64
+	ipMMap       map[uint64]*IpInfo
+	ips          []*IpInfo
+	numRoutes    int                         // numChannels if all the clients split their channels, 1 otherwise
+	backlogs     [numChannels][]slaveBacklog // Owned by each route
+	incoming     [numChannels]chan []byte
+	activeRoutes int32
+	interrupts   interruptCoalescer          // Owned by the route of the read channel, the first route
+	posted       map[uint64]map[*client]bool // Connections of the posted writes of each master since its last fence
+	fences       map[uint64]int              // FENCE_RESP messages each fencing master still needs
+	wg           sync.WaitGroup
+}
+
+// Both unix:// and shm:// clients rendez-vous over the same UNIX domain socket
+func socketPath(uri string) string {
+	if strings.HasPrefix(uri, "unix://") {
+		return uri[7:]
+	}
+	if strings.HasPrefix(uri, "shm://") {
+		return uri[6:]
+	}
+	return ""
 }
 
 func NewRouter(uri string, numClients int) (*Router, error) {
-	if !strings.HasPrefix(uri, "unix://") {
-		return nil, fmt.Errorf("Only unix:// protocol is supported")
+	if socketPath(uri) == "" {
+		return nil, fmt.Errorf("Only unix:// and shm:// protocols are supported")
 	}
 
 	if numClients <= 0 {
@@ -92,13 +154,18 @@ func NewRouter(uri string, numClients int) (*Router, error) {
 	router.uri = uri
 	router.numClients = numClients
 	router.ipMMap = make(map[uint64]*IpInfo)
-	router.incoming = make(chan []byte)
+	router.posted = make(map[uint64]map[*client]bool)
+	router.fences = make(map[uint64]int)
+	for ch := range router.incoming {
+		router.incoming[ch] = make(chan []byte, queueLength)
+	}
 	return &router, nil
 }
 
 func (r *Router) registerIp(ip *IpInfo) (uint64, error) {
 	if ip.Type == MASTER || ip.Type == MASTER_LITE || ip.Type == MASTER_STREAM {
 		r.masterCount++
+		r.clients[ip.ClientId].hasMasters = true
 	}
 
 	for _, rIp := range r.ips {
@@ -108,16 +175,65 @@ func (r *Router) registerIp(ip *IpInfo) (uint64, error) {
 		if ip.Address < rIp.Size && (ip.Address+ip.Size) > rIp.Address {
 			return 0, fmt.Errorf("Address space overlaps with already registered %s IP block", rIp.Name)
 		}
+		first, rFirst := uint32(ip.FirstInterrupt), uint32(rIp.FirstInterrupt)
+		if ip.NumInterrupts != 0 && rIp.NumInterrupts != 0 &&
+			first < rFirst+uint32(rIp.NumInterrupts) && rFirst < first+uint32(ip.NumInterrupts) {
+			return 0, fmt.Errorf("Interrupts overlap with those of already registered %s IP block", rIp.Name)
+		}
 	}
 	id := r.ipCount
 	ip.Id = id
 	r.ipCount++
 	r.ipMMap[ip.Address] = ip
 	r.ips = append(r.ips, ip)
+	for ch := range r.backlogs {
+		r.backlogs[ch] = append(r.backlogs[ch], slaveBacklog{})
+	}
 	log.Infof("[%20s] %s", r.clients[ip.ClientId].SystemInfo.Name, ip.String())
 	return id, nil
 }
 
+// Masters get what they ask for up to a limit, so that a single one cannot flood the router; slaves get exactly
+// what they ask for and the router holds back the requests that exceed it, counting the reads and the writes
+// separately
+func grantCredits(ip *IpInfo) uint32 {
+	if ip.Type != MASTER && ip.Type != MASTER_LITE && ip.Type != MASTER_STREAM {
+		return ip.MaxOutstanding
+	}
+	if ip.MaxOutstanding == 0 {
+		return defaultMasterCredits
+	}
+	if ip.MaxOutstanding > maxMasterCredits {
+		return maxMasterCredits
+	}
+	return ip.MaxOutstanding
+}
+
+// A slave has answered a request; hand it the next request of the route it has been held back from
+func (r *Router) releaseCredit(route int, slave uint64) {
+	if slave >= uint64(len(r.backlogs[route])) || r.ips[slave].MaxOutstanding == 0 {
+		return
+	}
+
+	b := &r.backlogs[route][slave]
+	if b.outstanding > 0 {
+		b.outstanding--
+	}
+	if len(b.txns) == 0 {
+		return
+	}
+
+	txn := b.txns[0]
+	b.txns = b.txns[1:]
+	b.outstanding++
+	r.connFor(slave, channelOf(txn.Type())).outgoing <- createTxnMessage([]*wire.Transaction{txn})
+}
+
+// The connection carrying the traffic of the IP block on the given channel
+func (r *Router) connFor(ip uint64, channel int) *client {
+	return r.clients[r.ips[ip].ClientId].connFor(ip, channel)
+}
+
 func (r *Router) sendDone() {
 	builder := flatbuffers.NewBuilder(0)
 	wire.MessageStart(builder)
@@ -125,7 +241,9 @@ func (r *Router) sendDone() {
 	builder.Finish(wire.MessageEnd(builder))
 
 	for _, ch := range r.clients {
-		ch.outgoing <- builder.FinishedBytes()
+		for _, conn := range ch.conns {
+			conn.outgoing <- builder.FinishedBytes()
+		}
 	}
 }
 
@@ -150,82 +268,344 @@ func (r *Router) findTarget(address, size uint64) (uint64, uint64, error) {
 	return ip.Id, ip.ClientId, nil
 }
 
-func (r *Router) route() {
-	for {
-		msgArr := <-r.incoming
-		msg := wire.GetRootAsMessage(msgArr, 0)
+// Build a message carrying the given transactions; a single transaction is sent in the plain form
+func createTxnMessage(txns []*wire.Transaction) []byte {
+	builder := flatbuffers.NewBuilder(0)
+	offsets := make([]flatbuffers.UOffsetT, len(txns))
+	for i, txn := range txns {
+		data := builder.CreateByteVector(txn.DataBytes())
+		msg := builder.CreateString(string(txn.Message()))
+		var strobe flatbuffers.UOffsetT
+		if txn.StrobeLength() != 0 {
+			strobe = builder.CreateByteVector(txn.StrobeBytes())
+		}
 
-		if msg.Type() == wire.TypeTERMINATE {
-			ip := r.ips[msg.IpId()]
-			log.Infof("[%20s] %s terminated", r.clients[ip.ClientId].SystemInfo.Name, ip.Name)
-			r.masterCount--
-			if r.masterCount == 0 {
-				log.Infof("No active master remains")
-				r.sendDone()
-				break
-			}
+		wire.TransactionStart(builder)
+		wire.TransactionAddType(builder, txn.Type())
+		wire.TransactionAddInitiator(builder, txn.Initiator())
+		wire.TransactionAddTarget(builder, txn.Target())
+		wire.TransactionAddId(builder, txn.Id())
+		wire.TransactionAddAddress(builder, txn.Address())
+		wire.TransactionAddSize(builder, txn.Size())
+		wire.TransactionAddData(builder, data)
+		wire.TransactionAddOk(builder, txn.Ok())
+		wire.TransactionAddMessage(builder, msg)
+		wire.TransactionAddEncoding(builder, txn.Encoding())
+		wire.TransactionAddQos(builder, txn.Qos())
+		wire.TransactionAddBurstLength(builder, txn.BurstLength())
+		wire.TransactionAddBurstSize(builder, txn.BurstSize())
+		wire.TransactionAddBurst(builder, txn.Burst())
+		wire.TransactionAddAxiId(builder, txn.AxiId())
+		wire.TransactionAddPosted(builder, txn.Posted())
+		if strobe != 0 {
+			wire.TransactionAddStrobe(builder, strobe)
 		}
+		offsets[i] = wire.TransactionEnd(builder)
+	}
 
-		if msg.Type() != wire.TypeTRANSACTION {
-			log.Fatalf("Received unexpected message: %s", msg.Type())
+	if len(txns) == 1 {
+		wire.MessageStart(builder)
+		wire.MessageAddType(builder, wire.TypeTRANSACTION)
+		wire.MessageAddTxn(builder, offsets[0])
+		builder.Finish(wire.MessageEnd(builder))
+		return builder.FinishedBytes()
+	}
+
+	wire.MessageStartTxnsVector(builder, len(offsets))
+	for i := len(offsets) - 1; i >= 0; i-- {
+		builder.PrependUOffsetT(offsets[i])
+	}
+	vec := builder.EndVector(len(offsets))
+
+	wire.MessageStart(builder)
+	wire.MessageAddType(builder, wire.TypeTRANSACTION_BATCH)
+	wire.MessageAddTxns(builder, vec)
+	builder.Finish(wire.MessageEnd(builder))
+	return builder.FinishedBytes()
+}
+
+// Fill in the target of the transaction and return the connection it needs to go to; if the transaction cannot be
+// routed, an error response is sent back to the initiator and nil is returned; if the target slave has no credits
+// left, the transaction is put in its backlog and nil is returned as well
+func (r *Router) routeTxn(route int, txn *wire.Transaction) *client {
+	channel := channelOf(txn.Type())
+	op := "Write"
+	if txn.Type() == wire.TransactionTypeREAD_RESP || txn.Type() == wire.TransactionTypeREAD_REQ {
+		op = "Read "
+	}
+	status := ""
+	if !txn.Ok() {
+		status = "error "
+	}
+
+	if txn.Type() == wire.TransactionTypeREAD_RESP || txn.Type() == wire.TransactionTypeWRITE_RESP {
+		log.Debugf("Routing %sresponse %d->%d %s:[0x%016x+0x%016x]", status, txn.Initiator(), txn.Target(),
+			op, txn.Address(), txn.Size())
+		if !txn.Posted() {
+			r.releaseCredit(route, txn.Target())
 		}
+		return r.connFor(txn.Initiator(), channel)
+	}
+
+	target, _, err := r.findTarget(txn.Address(), txn.Size())
+	if err != nil {
+		log.Debugf("Unable to find target: %s", err)
+		msgArr := createErrorTxn(txn, err)
+		r.connFor(txn.Initiator(), channel).outgoing <- msgArr
+		return nil
+	}
+
+	txn.MutateTarget(target)
+	log.Debugf("Routing %srequest %d->%d %s:[0x%016x+0x%016x]", status, txn.Initiator(), txn.Target(),
+		op, txn.Address(), txn.Size())
 
-		txn := msg.Txn(nil)
-		op := "Write"
-		if txn.Type() == wire.TransactionTypeREAD_RESP || txn.Type() == wire.TransactionTypeREAD_REQ {
-			op = "Read "
+	// Posted writes get no response to give the credit back, so they take none and are never held back; the
+	// fence of the master needs to pass the connections they go to
+	if txn.Posted() {
+		conn := r.connFor(target, channel)
+		if r.posted[txn.Initiator()] == nil {
+			r.posted[txn.Initiator()] = make(map[*client]bool)
 		}
-		status := ""
-		if !txn.Ok() {
-			status = "error "
+		r.posted[txn.Initiator()][conn] = true
+		return conn
+	}
+
+	if max := r.ips[target].MaxOutstanding; max != 0 {
+		b := &r.backlogs[route][target]
+		if b.outstanding >= max {
+			b.hold(txn)
+			return nil
 		}
+		b.outstanding++
+	}
+	return r.connFor(target, channel)
+}
+
+func createStreamCreditMessage(master uint64, credits uint32) []byte {
+	builder := flatbuffers.NewBuilder(0)
+	wire.MessageStart(builder)
+	wire.MessageAddType(builder, wire.TypeSTREAM_CREDIT)
+	wire.MessageAddIpId(builder, master)
+	wire.MessageAddCredits(builder, credits)
+	builder.Finish(wire.MessageEnd(builder))
+	return builder.FinishedBytes()
+}
 
-		if txn.Type() == wire.TransactionTypeREAD_RESP || txn.Type() == wire.TransactionTypeWRITE_RESP {
-			log.Debugf("Routing %sresponse %d->%d %s:[0x%016x+0x%016x]", status, txn.Initiator(), txn.Target(),
-				op, txn.Address(), txn.Size())
-			r.clients[r.ips[txn.Initiator()].ClientId].outgoing <- msgArr
+// Fill in the target of the stream chunk and forward it; stream data travels on the write channel and needs no
+// response, so a chunk that cannot be delivered is dropped and its credit given back to the stream master
+func (r *Router) routeStream(msgArr []byte, msg *wire.Message) {
+	chunk := msg.Chunk(nil)
+	target, _, err := r.findTarget(chunk.Address(), 1)
+	if err == nil && r.ips[target].Type != SLAVE_STREAM {
+		err = fmt.Errorf("%s is not a stream slave", r.ips[target].Name)
+	}
+	if err != nil {
+		log.Errorf("Dropping stream data of IP %d: %s", chunk.Initiator(), err)
+		r.connFor(chunk.Initiator(), writeChannel).outgoing <- createStreamCreditMessage(chunk.Initiator(), 1)
+		return
+	}
+
+	chunk.MutateTarget(target)
+	log.Debugf("Routing stream data %d->%d [%d bytes]", chunk.Initiator(), target, chunk.DataLength())
+	r.connFor(target, writeChannel).outgoing <- msgArr
+}
+
+// Pass the fence of the master on to all the connections its posted writes have gone to since its previous fence;
+// each of them answers once the writes received before the fence have been handled, and the master gets its answer
+// once all of them have
+func (r *Router) routeFenceRequest(msgArr []byte, master uint64) {
+	conns := r.posted[master]
+	delete(r.posted, master)
+	if len(conns) == 0 {
+		r.connFor(master, writeChannel).outgoing <- createFenceResponse(master)
+		return
+	}
+
+	log.Debugf("Fencing the posted writes of IP %d on %d connections", master, len(conns))
+	r.fences[master] = len(conns)
+	for conn := range conns {
+		conn.outgoing <- msgArr
+	}
+}
+
+func (r *Router) routeFenceResponse(msgArr []byte, master uint64) {
+	if r.fences[master]--; r.fences[master] > 0 {
+		return
+	}
+	delete(r.fences, master)
+	r.connFor(master, writeChannel).outgoing <- msgArr
+}
+
+func createFenceResponse(master uint64) []byte {
+	builder := flatbuffers.NewBuilder(0)
+	wire.MessageStart(builder)
+	wire.MessageAddType(builder, wire.TypeFENCE_RESP)
+	wire.MessageAddIpId(builder, master)
+	builder.Finish(wire.MessageEnd(builder))
+	return builder.FinishedBytes()
+}
+
+// Route all the transactions of a batch; the batch is forwarded as is if all of them go to the same connection,
+// otherwise it is split into one batch per destination
+func (r *Router) routeBatch(route int, msgArr []byte, msg *wire.Message) {
+	dests := make([]*client, msg.TxnsLength())
+	txns := make([]*wire.Transaction, msg.TxnsLength())
+	same := true
+	for i := range txns {
+		txns[i] = new(wire.Transaction)
+		msg.Txns(txns[i], i)
+		dests[i] = r.routeTxn(route, txns[i])
+		if dests[i] != dests[0] {
+			same = false
+		}
+	}
+
+	if len(txns) == 0 || (same && dests[0] == nil) {
+		return
+	}
+
+	if same {
+		dests[0].outgoing <- msgArr
+		return
+	}
+
+	perConn := make(map[*client][]*wire.Transaction)
+	for i, txn := range txns {
+		if dests[i] != nil {
+			perConn[dests[i]] = append(perConn[dests[i]], txn)
+		}
+	}
+	for conn, connTxns := range perConn {
+		conn.outgoing <- createTxnMessage(connTxns)
+	}
+}
+
+// Route the transactions coming in on the given route; every master terminates on each channel once it is done with
+// it, so the route waits for the given number of terminations, and the last route to see all the masters go tells
+// the clients that the simulation is over; the interrupts travel with the reads, and the first route, which takes
+// the reads, also delivers the interrupts it holds back once they are due
+func (r *Router) route(route int, terminations uint64) {
+	for {
+		var interruptsDue <-chan time.Time
+		if route == readChannel {
+			interruptsDue = r.interrupts.expired()
+		}
+
+		var msgArr []byte
+		select {
+		case msgArr = <-r.incoming[route]:
+		case <-interruptsDue:
+			r.flushInterrupts()
 			continue
 		}
+		msg := wire.GetRootAsMessage(msgArr, 0)
 
-		if txn.Type() == wire.TransactionTypeREAD_REQ || txn.Type() == wire.TransactionTypeWRITE_REQ {
-			target, client, err := r.findTarget(txn.Address(), txn.Size())
-			if err != nil {
-				log.Debugf("Unable to find target: %s", err)
-				msgArr = createErrorTxn(txn.Initiator(), txn.Id(), txn.Type(), err)
-				r.clients[r.ips[txn.Initiator()].ClientId].outgoing <- msgArr
-				continue
+		switch msg.Type() {
+		case wire.TypeTERMINATE:
+			terminations--
+			if route == readChannel {
+				ip := r.ips[msg.IpId()]
+				log.Infof("[%20s] %s terminated", r.clients[ip.ClientId].SystemInfo.Name, ip.Name)
+			}
+			if terminations == 0 {
+				if route == readChannel {
+					r.flushInterrupts()
+				}
+				if atomic.AddInt32(&r.activeRoutes, -1) == 0 {
+					log.Infof("No active master remains")
+					r.sendDone()
+				}
+				r.wg.Done()
+				return
 			}
 
-			msg.Txn(nil).MutateTarget(target)
-			log.Debugf("Routing %srequest %d->%d %s:[0x%016x+0x%016x]", status, txn.Initiator(), txn.Target(),
-				op, txn.Address(), txn.Size())
+		case wire.TypeTRANSACTION:
+			if conn := r.routeTxn(route, msg.Txn(nil)); conn != nil {
+				conn.outgoing <- msgArr
+			}
 
-			r.clients[client].outgoing <- msgArr
-			continue
+		case wire.TypeTRANSACTION_BATCH:
+			r.routeBatch(route, msgArr, msg)
+
+		case wire.TypeSTREAM:
+			r.routeStream(msgArr, msg)
+
+		case wire.TypeSTREAM_CREDIT:
+			r.connFor(msg.IpId(), writeChannel).outgoing <- msgArr
+
+		case wire.TypeINTERRUPT:
+			r.routeInterrupt(msg)
+
+		case wire.TypeFENCE_REQ:
+			r.routeFenceRequest(msgArr, msg.IpId())
+
+		case wire.TypeFENCE_RESP:
+			r.routeFenceResponse(msgArr, msg.IpId())
+
+		default:
+			log.Fatalf("Received unexpected message: %s", msg.Type())
 		}
 	}
-	r.wg.Done()
+}
+
+// Add the data connection to the client that it names in its ATTACH message; the connections of a client have to
+// attach in order
+func (r *Router) attachConn(conn net.Conn) error {
+	s := newClient(0, conn, &r.wg)
+	msgArr, err := s.readMsg()
+	if err != nil {
+		return err
+	}
+
+	msg := wire.GetRootAsMessage(msgArr, 0)
+	if msg.Type() != wire.TypeATTACH {
+		return fmt.Errorf("Expected an ATTACH message but got: %s", wire.EnumNamesType[msg.Type()])
+	}
+
+	if msg.ClientId() >= uint64(len(r.clients)) {
+		err := fmt.Errorf("No client with ID %d", msg.ClientId())
+		s.sendError(err)
+		return err
+	}
+
+	ch := r.clients[msg.ClientId()]
+	index := int(msg.Stripe())
+	if index != len(ch.conns) || index >= ch.numConns() {
+		err := fmt.Errorf("Client %s has not announced data connection %d", ch.SystemInfo.Name, msg.Stripe())
+		s.sendError(err)
+		return err
+	}
+
+	s.Id = ch.Id
+	s.SystemInfo = ch.SystemInfo
+	s.rd = bufio.NewReaderSize(conn, ioBufferSize)
+	s.incoming = r.incoming[readChannel]
+	if r.numRoutes == numChannels && index >= int(ch.numStripes) {
+		s.incoming = r.incoming[writeChannel]
+	}
+	ch.conns = append(ch.conns, s)
+	log.Infof("[%20s] Attached data connection %d", ch.SystemInfo.Name, msg.Stripe())
+	return s.ack()
 }
 
 func (r *Router) Run() error {
-	if err := os.RemoveAll(r.uri[7:]); err != nil {
+	path := socketPath(r.uri)
+	if err := os.RemoveAll(path); err != nil {
 		return fmt.Errorf("Can't remove the socket file: %s", err)
 	}
 
-	l, err := net.Listen("unix", r.uri[7:])
+	l, err := net.Listen("unix", path)
 	if err != nil {
 		return fmt.Errorf("Can't listen at %s: %s", r.uri, err)
 	}
 	defer l.Close()
 
-	r.wg.Add(r.numClients*2 + 1)
-
 	for i := 0; i < r.numClients; i++ {
 		conn, err := l.Accept()
 		if err != nil {
 			return fmt.Errorf("Can't accept a client connection: %s", err)
 		}
-		ch := newClient(i, conn, r.incoming, &r.wg)
+		ch := newClient(i, conn, &r.wg)
 		r.clients = append(r.clients, ch)
 		defer ch.close()
 	}
@@ -253,7 +633,7 @@ func (r *Router) Run() error {
 					return fmt.Errorf("Can't receive IP info from client %s: %s", ch.SystemInfo.Name, err)
 				}
 			} else {
-				if err := ch.ackIpInfo(id); err != nil {
+				if err := ch.ackIpInfo(id, grantCredits(ipInfo)); err != nil {
 					return fmt.Errorf("Can't receive IP info from client %s: %s", ch.SystemInfo.Name, err)
 				}
 			}
@@ -261,18 +641,69 @@ func (r *Router) Run() error {
 		clInfo = append(clInfo, ch.SystemInfo)
 	}
 
+	// A single client keeping its channels together has all the traffic go through a single route; the control
+	// connection carries the reads either way
+	r.numRoutes = numChannels
+	for _, ch := range r.clients {
+		if !ch.split {
+			r.numRoutes = 1
+		}
+	}
+	for _, ch := range r.clients {
+		ch.incoming = r.incoming[readChannel]
+	}
+
 	for _, ch := range r.clients {
 		if err := ch.commit(clInfo, r.ips); err != nil {
 			return fmt.Errorf("Can't shake hands with client %s: %s", ch.SystemInfo.Name, err)
 		}
 	}
 
+	// The additional data connections of the clients can only attach once their control connections have been
+	// through the handshake
+	numConns := r.numClients
 	for _, ch := range r.clients {
-		go ch.writer()
-		go ch.reader()
+		numConns += ch.numConns() - 1
+	}
+	for i := r.numClients; i < numConns; i++ {
+		conn, err := l.Accept()
+		if err != nil {
+			return fmt.Errorf("Can't accept a data connection: %s", err)
+		}
+		if err := r.attachConn(conn); err != nil {
+			conn.Close()
+			return fmt.Errorf("Can't attach a data connection: %s", err)
+		}
 	}
 
-	go r.route()
+	// Each route sees the termination of every master once, except for the single route, which sees a master
+	// terminate on each of the channels of its client
+	terminations := r.masterCount
+	if r.numRoutes == 1 {
+		terminations = 0
+		for _, ip := range r.ips {
+			if ip.Type != MASTER && ip.Type != MASTER_LITE && ip.Type != MASTER_STREAM {
+				continue
+			}
+			terminations++
+			if r.clients[ip.ClientId].split {
+				terminations++
+			}
+		}
+	}
+
+	r.wg.Add(numConns*2 + r.numRoutes)
+	for _, ch := range r.clients {
+		for _, conn := range ch.conns {
+			go conn.writer()
+			go conn.reader()
+		}
+	}
+
+	r.activeRoutes = int32(r.numRoutes)
+	for route := 0; route < r.numRoutes; route++ {
+		go r.route(route, terminations)
+	}
 
 	r.wg.Wait()
 
@@ -0,0 +1,277 @@
+//------------------------------------------------------------------------------
+// Copyright (C) 2020 Daedalean AG
+//
+// This file is part of SW-AXI.
+//
+// SW-AXI is free software: you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+//
+// SW-AXI is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with SW-AXI.  If not, see <https://www.gnu.org/licenses/>.
+//------------------------------------------------------------------------------
+
+package sw_axi
+
+import (
+	"encoding/binary"
+	"fmt"
+	"net"
+	"sync/atomic"
+	"syscall"
+	"unsafe"
+)
+
+// The layout of the ring is shared with src/common/ShmRing.hh
+const (
+	shmHead         = 0x000
+	shmTail         = 0x040
+	shmDataSeq      = 0x080
+	shmDataWaiting  = 0x084
+	shmSpaceSeq     = 0x0c0
+	shmSpaceWaiting = 0x0c4
+	shmClosed       = 0x100
+	shmCapacity     = 0x108
+	shmHeaderSize   = 0x140
+
+	shmContinued = uint64(1) << 63
+	shmWrap      = ^uint64(0)
+	shmSpinCount = 256
+
+	futexWait = 0
+	futexWake = 1
+)
+
+// A single-producer single-consumer ring of messages in memory shared with a client
+type shmRing struct {
+	mem      []byte
+	data     []byte
+	capacity uint64
+	needed   uint64
+}
+
+func newShmRing(mem []byte) (*shmRing, error) {
+	r := &shmRing{mem: mem}
+	r.capacity = atomic.LoadUint64(r.u64(shmCapacity))
+	if r.capacity == 0 || r.capacity&(r.capacity-1) != 0 || uint64(len(mem)) < shmHeaderSize+r.capacity {
+		return nil, fmt.Errorf("Malformed shared memory ring of capacity %d", r.capacity)
+	}
+	r.data = mem[shmHeaderSize : shmHeaderSize+r.capacity]
+	return r, nil
+}
+
+func (r *shmRing) u64(off int) *uint64 {
+	return (*uint64)(unsafe.Pointer(&r.mem[off]))
+}
+
+func (r *shmRing) u32(off int) *uint32 {
+	return (*uint32)(unsafe.Pointer(&r.mem[off]))
+}
+
+func (r *shmRing) isClosed() bool {
+	return atomic.LoadUint32(r.u32(shmClosed)) != 0
+}
+
+func (r *shmRing) hasData() bool {
+	return atomic.LoadUint64(r.u64(shmHead)) != atomic.LoadUint64(r.u64(shmTail))
+}
+
+func (r *shmRing) hasSpace() bool {
+	used := atomic.LoadUint64(r.u64(shmHead)) - atomic.LoadUint64(r.u64(shmTail))
+	return r.capacity-used >= r.needed
+}
+
+func futex(addr *uint32, op int, val uint32, timeout *syscall.Timespec) {
+	syscall.Syscall6(syscall.SYS_FUTEX, uintptr(unsafe.Pointer(addr)), uintptr(op), uintptr(val),
+		uintptr(unsafe.Pointer(timeout)), 0, 0)
+}
+
+func (r *shmRing) waitFor(seq, waiting int, ready func() bool) error {
+	for i := 0; i < shmSpinCount; i++ {
+		if ready() {
+			return nil
+		}
+	}
+
+	timeout := syscall.NsecToTimespec(50 * 1000 * 1000)
+	for {
+		s := atomic.LoadUint32(r.u32(seq))
+		atomic.StoreUint32(r.u32(waiting), 1)
+		if ready() {
+			atomic.StoreUint32(r.u32(waiting), 0)
+			return nil
+		}
+		if r.isClosed() {
+			atomic.StoreUint32(r.u32(waiting), 0)
+			return fmt.Errorf("The shared memory ring has been closed")
+		}
+		futex(r.u32(seq), futexWait, s, &timeout)
+		atomic.StoreUint32(r.u32(waiting), 0)
+	}
+}
+
+func (r *shmRing) wake(seq, waiting int) {
+	atomic.AddUint32(r.u32(seq), 1)
+	if atomic.LoadUint32(r.u32(waiting)) != 0 {
+		futex(r.u32(seq), futexWake, 1<<30, nil)
+	}
+}
+
+func (r *shmRing) write(msg []byte) error {
+	maxChunk := (r.capacity/4)&^7 - 8
+	remaining := uint64(len(msg))
+
+	for first := true; first || remaining > 0; first = false {
+		if r.isClosed() {
+			return fmt.Errorf("The shared memory ring has been closed")
+		}
+
+		chunk := remaining
+		if chunk > maxChunk {
+			chunk = maxChunk
+		}
+		recordSize := 8 + (chunk+7)&^7
+		head := atomic.LoadUint64(r.u64(shmHead))
+		pos := head & (r.capacity - 1)
+		skip := uint64(0)
+		if r.capacity-pos < recordSize {
+			skip = r.capacity - pos
+		}
+
+		r.needed = skip + recordSize
+		if err := r.waitFor(shmSpaceSeq, shmSpaceWaiting, r.hasSpace); err != nil {
+			return err
+		}
+
+		if skip != 0 {
+			binary.LittleEndian.PutUint64(r.data[pos:], shmWrap)
+			pos = 0
+		}
+
+		remaining -= chunk
+		header := chunk
+		if remaining > 0 {
+			header |= shmContinued
+		}
+		binary.LittleEndian.PutUint64(r.data[pos:], header)
+		copy(r.data[pos+8:], msg[:chunk])
+		msg = msg[chunk:]
+
+		atomic.StoreUint64(r.u64(shmHead), head+skip+recordSize)
+		r.wake(shmDataSeq, shmDataWaiting)
+	}
+	return nil
+}
+
+func (r *shmRing) nextRecord() (uint64, error) {
+	for {
+		if err := r.waitFor(shmDataSeq, shmDataWaiting, r.hasData); err != nil {
+			return 0, err
+		}
+
+		tail := atomic.LoadUint64(r.u64(shmTail))
+		pos := tail & (r.capacity - 1)
+		header := binary.LittleEndian.Uint64(r.data[pos:])
+		if header != shmWrap {
+			return header, nil
+		}
+		atomic.StoreUint64(r.u64(shmTail), tail+r.capacity-pos)
+		r.wake(shmSpaceSeq, shmSpaceWaiting)
+	}
+}
+
+// Read a message and copy it out of the ring; the messages are passed between goroutines so they cannot
+// stay in place
+func (r *shmRing) read() ([]byte, error) {
+	var msg []byte
+	for {
+		header, err := r.nextRecord()
+		if err != nil {
+			return nil, err
+		}
+
+		tail := atomic.LoadUint64(r.u64(shmTail))
+		pos := tail & (r.capacity - 1)
+		size := header &^ shmContinued
+		msg = append(msg, r.data[pos+8:pos+8+size]...)
+		atomic.StoreUint64(r.u64(shmTail), tail+8+(size+7)&^7)
+		r.wake(shmSpaceSeq, shmSpaceWaiting)
+
+		if header&shmContinued == 0 {
+			return msg, nil
+		}
+	}
+}
+
+func (r *shmRing) close() {
+	atomic.StoreUint32(r.u32(shmClosed), 1)
+	r.wake(shmDataSeq, shmDataWaiting)
+	r.wake(shmSpaceSeq, shmSpaceWaiting)
+}
+
+// The pair of rings shared with a client; the client's transmit ring comes first
+type shmChannel struct {
+	mem []byte
+	rx  *shmRing
+	tx  *shmRing
+}
+
+// Receive the memory segment passed by the client over the rendez-vous socket and map it
+func attachShm(conn net.Conn, capacity uint64) (*shmChannel, error) {
+	uc, ok := conn.(*net.UnixConn)
+	if !ok {
+		return nil, fmt.Errorf("Shared memory is only supported over UNIX domain sockets")
+	}
+
+	buf := make([]byte, 1)
+	oob := make([]byte, syscall.CmsgSpace(4))
+	_, oobn, _, _, err := uc.ReadMsgUnix(buf, oob)
+	if err != nil {
+		return nil, fmt.Errorf("Unable to receive the shared memory segment: %s", err)
+	}
+
+	scms, err := syscall.ParseSocketControlMessage(oob[:oobn])
+	if err != nil || len(scms) != 1 {
+		return nil, fmt.Errorf("Unable to parse the shared memory control message: %v", err)
+	}
+	fds, err := syscall.ParseUnixRights(&scms[0])
+	if err != nil || len(fds) != 1 {
+		return nil, fmt.Errorf("Unable to parse the shared memory descriptor: %v", err)
+	}
+	defer syscall.Close(fds[0])
+
+	ringSize := int(shmHeaderSize + capacity)
+	mem, err := syscall.Mmap(fds[0], 0, 2*ringSize, syscall.PROT_READ|syscall.PROT_WRITE, syscall.MAP_SHARED)
+	if err != nil {
+		return nil, fmt.Errorf("Unable to map the shared memory segment: %s", err)
+	}
+
+	ch := &shmChannel{mem: mem}
+	if ch.rx, err = newShmRing(mem[:ringSize]); err != nil {
+		syscall.Munmap(mem)
+		return nil, err
+	}
+	if ch.tx, err = newShmRing(mem[ringSize:]); err != nil {
+		syscall.Munmap(mem)
+		return nil, err
+	}
+
+	// The socket stays silent after the handshake; it only tells us when the client goes away
+	go func() {
+		buf := make([]byte, 1)
+		for {
+			if _, err := conn.Read(buf); err != nil {
+				ch.rx.close()
+				ch.tx.close()
+				return
+			}
+		}
+	}()
+	return ch, nil
+}
@@ -106,6 +106,33 @@ extern "C" void sw_axi_client_retrieve_ip_config(void *client, void **status, vo
     *status = new Status(ret.second);
 }
 
+extern "C" void sw_axi_client_place_thread(void *client, void **status, const char *cpus, int fifoPriority) {
+    if (!client || !status || !cpus) {
+        std::cerr << "Either of client, status, or cpus pointers is null" << std::endl;
+        std::terminate();
+    }
+    RouterClient *c = reinterpret_cast<RouterClient *>(client);
+    ThreadPlacement placement;
+    placement.fifoPriority = fifoPriority;
+    Status st = parseCpuList(cpus, placement.cpus);
+    if (st.isOk()) {
+        st = placeThread(pthread_self(), placement);
+    }
+    if (st.isOk() && !placement.cpus.empty()) {
+        c->bindToLocalNode();
+    }
+    *status = new Status(st);
+}
+
+extern "C" void sw_axi_client_raise_interrupt(void *client, void **status, unsigned number) {
+    if (!client || !status) {
+        std::cerr << "Either client or status pointer is null" << std::endl;
+        std::terminate();
+    }
+    RouterClient *c = reinterpret_cast<RouterClient *>(client);
+    *status = new Status(c->sendInterrupt(number));
+}
+
 extern "C" void sw_axi_client_disconnect(void *client) {
     if (!client) {
         std::cerr << "The client pointer is null" << std::endl;
@@ -27,6 +27,8 @@ import "DPI-C" function void sw_axi_client_register_slave(chandle client, output
 import "DPI-C" function void sw_axi_client_commit_ip(chandle client, output chandle status);
 import "DPI-C" function void sw_axi_client_retrieve_peer_info(chandle client, output chandle status, output chandle systemInfo);
 import "DPI-C" function void sw_axi_client_retrieve_ip_config(chandle client, output chandle status, output chandle ipConfig);
+import "DPI-C" function void sw_axi_client_place_thread(chandle client, output chandle status, input string cpus, input int fifoPriority);
+import "DPI-C" function void sw_axi_client_raise_interrupt(chandle client, output chandle status, input int unsigned number);
 import "DPI-C" function void sw_axi_client_disconnect(chandle client);
 
 /**
@@ -52,8 +54,8 @@ class Bridge;
   /**
    * Connect to the router
    *
-   * @param uri an URI pointing to a rendez-vous point with the router; currently only UNIX domain sockets are
-   *            supported
+   * @param uri an URI pointing to a rendez-vous point with the router; either `unix://path` for a UNIX domain
+   *            socket or `shm://path` for shared memory rings set up over the socket at path
    */
   function Status connect (string uri = "unix:///tmp/sw-axi");
     chandle st;
@@ -67,6 +69,20 @@ class Bridge;
     return convertStatus(st);
   endfunction
 
+  /**
+   * Pin the simulator thread calling into the bridge to the given CPUs and move the receive buffers to their NUMA
+   * node; must be called after connect
+   *
+   * @param cpus         a list of CPUs in the format used by `taskset -c`, e.g. `0-3,8`; empty leaves the affinity
+   *                     unchanged
+   * @param fifoPriority real-time priority under the SCHED_FIFO policy, from 1 to 99; 0 keeps the current policy
+   */
+  function Status placeThread(string cpus, int fifoPriority = 0);
+    chandle st;
+    sw_axi_client_place_thread(client, st, cpus, fifoPriority);
+    return convertStatus(st);
+  endfunction
+
   /**
    * Register a slave with the given parameters
    */
@@ -132,6 +148,16 @@ class Bridge;
   endfunction
 
 
+  /**
+   * Raise one of the interrupt lines allocated to the registered slaves; the router delivers it to the software
+   */
+  function Status raiseInterrupt(int unsigned number);
+    chandle st;
+    sw_axi_client_raise_interrupt(client, st, number);
+    return convertStatus(st);
+  endfunction
+
+
   /**
    * Disconnect from the router
    */
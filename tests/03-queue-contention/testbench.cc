@@ -0,0 +1,164 @@
+
+#include <Queue.hh>
+
+#include <chrono>
+#include <condition_variable>
+#include <cstdint>
+#include <iomanip>
+#include <iostream>
+#include <mutex>
+#include <queue>
+#include <thread>
+#include <vector>
+
+namespace {
+
+const uint64_t ITEMS_PER_PRODUCER = 200000;
+
+struct Item {
+    uint32_t producer = 0;
+    uint64_t seq = 0;
+};
+
+/**
+ * The mutex and condition variable queue that sw_axi::Queue replaced; kept here as the baseline
+ */
+class LockedQueue {
+public:
+    bool pop(Item &t) {
+        std::unique_lock<std::mutex> scopedLock(mutex);
+        while (queue.empty()) {
+            if (done) {
+                return false;
+            }
+            condVar.wait(scopedLock);
+        }
+        t = queue.front();
+        queue.pop();
+        return true;
+    }
+
+    void push(Item &&item) {
+        mutex.lock();
+        queue.push(item);
+        mutex.unlock();
+        condVar.notify_one();
+    }
+
+    void finish() {
+        mutex.lock();
+        done = true;
+        mutex.unlock();
+        condVar.notify_one();
+    }
+
+private:
+    std::queue<Item> queue;
+    std::mutex mutex;
+    bool done = false;
+    std::condition_variable condVar;
+};
+
+/**
+ * Push from the given number of threads while a single consumer drains the queue; check that the items of each
+ * producer come out in order
+ *
+ * @return the number of items per second or a negative value if the order was broken
+ */
+template<typename Q>
+double run(unsigned numProducers) {
+    Q queue;
+    std::vector<uint64_t> expected(numProducers, 0);
+    bool ordered = true;
+
+    auto start = std::chrono::steady_clock::now();
+    std::thread consumer([&]() {
+        Item item;
+        while (queue.pop(item)) {
+            ordered = ordered && item.seq == expected[item.producer];
+            expected[item.producer] = item.seq + 1;
+        }
+    });
+
+    std::vector<std::thread> producers;
+    for (unsigned p = 0; p < numProducers; ++p) {
+        producers.emplace_back([&queue, p]() {
+            for (uint64_t i = 0; i < ITEMS_PER_PRODUCER; ++i) {
+                Item item;
+                item.producer = p;
+                item.seq = i;
+                queue.push(std::move(item));
+            }
+        });
+    }
+    for (auto &t : producers) {
+        t.join();
+    }
+    queue.finish();
+    consumer.join();
+    std::chrono::duration<double> elapsed = std::chrono::steady_clock::now() - start;
+
+    for (uint64_t e : expected) {
+        ordered = ordered && e == ITEMS_PER_PRODUCER;
+    }
+    return ordered ? numProducers * ITEMS_PER_PRODUCER / elapsed.count() : -1;
+}
+
+/**
+ * Overfill a small queue with pushNoWait before the consumer starts, so that most items spill over, then drain it
+ * while a second producer keeps pushing; check that nothing is lost or reordered
+ */
+bool checkOverflow() {
+    const uint64_t numItems = 10000;
+    sw_axi::Queue<Item, 16> queue;
+    for (uint64_t i = 0; i < numItems; ++i) {
+        Item item;
+        item.seq = i;
+        queue.pushNoWait(std::move(item));
+    }
+
+    std::thread producer([&queue]() {
+        for (uint64_t i = 0; i < numItems; ++i) {
+            Item item;
+            item.producer = 1;
+            item.seq = i;
+            queue.pushNoWait(std::move(item));
+        }
+        queue.finish();
+    });
+
+    std::vector<uint64_t> expected(2, 0);
+    bool ordered = true;
+    Item item;
+    while (queue.pop(item)) {
+        ordered = ordered && item.seq == expected[item.producer];
+        expected[item.producer] = item.seq + 1;
+    }
+    producer.join();
+    return ordered && expected[0] == numItems && expected[1] == numItems;
+}
+
+}  // namespace
+
+int main(int argc, char **argv) {
+    std::cout << std::setw(10) << "producers" << std::setw(16) << "locked [Mop/s]" << std::setw(20)
+              << "lock-free [Mop/s]" << std::endl;
+
+    for (unsigned numProducers : {1, 2, 4, 8, 16, 32}) {
+        double locked = run<LockedQueue>(numProducers);
+        double lockFree = run<sw_axi::Queue<Item>>(numProducers);
+        if (locked < 0 || lockFree < 0) {
+            std::cerr << "The items of a producer came out of order with " << numProducers << " producers"
+                      << std::endl;
+            return 1;
+        }
+        std::cout << std::setw(10) << numProducers << std::fixed << std::setprecision(2) << std::setw(16)
+                  << locked / 1e6 << std::setw(20) << lockFree / 1e6 << std::endl;
+    }
+
+    if (!checkOverflow()) {
+        std::cerr << "The items pushed over a full queue were lost or came out of order" << std::endl;
+        return 1;
+    }
+    return 0;
+}
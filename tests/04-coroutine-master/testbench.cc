@@ -0,0 +1,136 @@
+
+#include <Coroutine.hh>
+
+#include <atomic>
+#include <cstring>
+#include <iostream>
+
+class Ram : public sw_axi::Slave {
+public:
+    Ram(uint64_t addr, uint64_t size) : addr(addr) {
+        data = new uint8_t[size];
+    }
+    ~Ram() {
+        delete[] data;
+    }
+    virtual int handleWrite(const sw_axi::Buffer *buffer) {
+        memcpy(data + (buffer->address - addr), buffer->data, buffer->size);
+        return 0;
+    }
+    virtual int handleRead(sw_axi::Buffer *buffer) {
+        memcpy(buffer->data, data + (buffer->address - addr), buffer->size);
+        return 0;
+    }
+
+private:
+    uint8_t *data;
+    uint64_t addr;
+};
+
+const uint64_t RAM_SIZE = 0x10000;
+const uint64_t RAM_ADDR = 0x1000;
+const unsigned NUM_SCRIPTS = 1000;
+const unsigned WORDS_PER_SCRIPT = RAM_SIZE / NUM_SCRIPTS / sizeof(uint64_t);
+
+/**
+ * A register script: write a pattern to its own window of the RAM and read it back one word at a time
+ */
+sw_axi::Task script(sw_axi::Executor &executor, sw_axi::Master *master, unsigned index, std::atomic<unsigned> &ok) {
+    using namespace sw_axi;
+    co_await executor.schedule();
+
+    uint64_t base = RAM_ADDR + index * WORDS_PER_SCRIPT * sizeof(uint64_t);
+    for (unsigned i = 0; i < WORDS_PER_SCRIPT; ++i) {
+        uint64_t value = uint64_t(index) << 32 | i;
+        Buffer buffer = {.data = reinterpret_cast<uint8_t *>(&value), .size = sizeof(value), .address = base + i * 8};
+        Status st = co_await master->writeAsync(&buffer);
+        if (st.isError()) {
+            std::cerr << "Write failed: " << st.getMessage() << std::endl;
+            co_return;
+        }
+    }
+
+    for (unsigned i = 0; i < WORDS_PER_SCRIPT; ++i) {
+        uint64_t value = 0;
+        Buffer buffer = {.data = reinterpret_cast<uint8_t *>(&value), .size = sizeof(value), .address = base + i * 8};
+        Status st = co_await master->readAsync(&buffer);
+        if (st.isError() || value != (uint64_t(index) << 32 | i)) {
+            std::cerr << "Read back a wrong value at 0x" << std::hex << buffer.address << std::dec << std::endl;
+            co_return;
+        }
+    }
+    ++ok;
+}
+
+int main(int argc, char **argv) {
+    using namespace sw_axi;
+
+    Bridge bridge("04-coroutine-master");
+
+    Status st = bridge.connect();
+    if (st.isError()) {
+        std::cerr << "Unable to connect to the router: " << st.getMessage() << std::endl;
+        return 1;
+    }
+
+    Ram *ram = new Ram(RAM_ADDR, RAM_SIZE);
+    IpConfig ramConfig = {
+            .name = "Soft-RAM",
+            .address = RAM_ADDR,
+            .size = RAM_SIZE,
+            .firstInterrupt = 0,
+            .numInterrupts = 0,
+            .type = IpType::SLAVE_LITE,
+            .implementation = IpImplementation::SOFTWARE};
+
+    st = bridge.registerSlave(ram, ramConfig);
+    if (st.isError()) {
+        std::cerr << "Unable to register the Soft-RAM slave: " << st.getMessage() << std::endl;
+        return 1;
+    }
+
+    std::pair<Master *, Status> ret = bridge.registerMaster("Soft-Master");
+    if (ret.second.isError()) {
+        std::cerr << "Unable register a master IP: " << ret.second.getMessage() << std::endl;
+        return 1;
+    }
+    Master *master = ret.first;
+
+    st = bridge.commitIp();
+    if (st.isError()) {
+        std::cerr << "Unable to commit the IP: " << st.getMessage() << std::endl;
+        return 1;
+    }
+
+    st = bridge.start();
+    if (st.isError()) {
+        std::cerr << "Unable to start the bridge: " << st.getMessage() << std::endl;
+        return 1;
+    }
+
+    std::atomic<unsigned> ok(0);
+    {
+        Executor executor(2);
+        for (unsigned i = 0; i < NUM_SCRIPTS; ++i) {
+            executor.spawn(script(executor, master, i, ok));
+        }
+        executor.waitIdle();
+    }
+
+    std::cout << ok << " of " << NUM_SCRIPTS << " scripts succeeded" << std::endl;
+    std::cout << (ok == NUM_SCRIPTS ? "MATCH!" : "NO MATCH!") << std::endl;
+
+    std::cerr << "Terminating the master" << std::endl;
+    master->terminate();
+
+    st = bridge.waitForCompletion();
+    if (st.isError()) {
+        std::cerr << "Failed to complete without errors: " << st.getMessage() << std::endl;
+        return 1;
+    }
+
+    std::cerr << "Disconnecting" << std::endl;
+    bridge.disconnect();
+
+    return ok == NUM_SCRIPTS ? 0 : 1;
+}
@@ -0,0 +1,180 @@
+
+#include <../common/Encoding.hh>
+#include <Burst.hh>
+
+#include <cstdint>
+#include <cstring>
+#include <iostream>
+#include <vector>
+
+namespace {
+
+using namespace sw_axi;
+
+int failures = 0;
+
+void check(bool condition, const std::string &what) {
+    if (!condition) {
+        std::cerr << "FAILED: " << what << std::endl;
+        ++failures;
+    }
+}
+
+/**
+ * Verify the invariants every split has to hold: the bursts cover the transfer back to back and are legal
+ */
+void checkSplit(uint64_t address, uint64_t size, unsigned beatSize, const std::vector<Burst> &bursts) {
+    uint64_t offset = 0;
+    for (const Burst &b : bursts) {
+        check(b.offset == offset, "the bursts are contiguous");
+        check(b.address == address + offset, "the burst starts where the previous one ended");
+        check(b.length >= 1 && b.length <= MAX_INCR_BEATS, "the burst has at most 256 beats");
+        check(b.address / BURST_BOUNDARY == (b.address + b.size - 1) / BURST_BOUNDARY, "no 4 KB boundary is crossed");
+        uint64_t aligned = b.address - b.address % beatSize;
+        check((b.address - aligned + b.size + beatSize - 1) / beatSize == b.length, "the beats cover the burst");
+        offset += b.size;
+    }
+    check(offset == size, "the bursts cover the transfer");
+}
+
+/**
+ * Encode the payload, make sure it shrinks, and decode it back
+ */
+std::vector<uint8_t> checkRoundTrip(const std::vector<uint8_t> &payload, const std::string &what) {
+    std::vector<uint8_t> encoded;
+    size_t size = encodeRle(payload.data(), payload.size(), encoded);
+    check(size != 0 && size == encoded.size() && size < payload.size(), what + " is compressed");
+
+    std::vector<uint8_t> decoded(payload.size(), 0x5a);
+    check(decodeRle(encoded.data(), encoded.size(), decoded.data(), decoded.size()) == 0, what + " is decoded");
+    check(decoded == payload, what + " survives the round trip");
+    return encoded;
+}
+
+/**
+ * A deterministic, incompressible filler
+ */
+void fillNoise(std::vector<uint8_t> &payload, size_t offset, size_t size) {
+    uint32_t state = 0x12345678 + uint32_t(offset);
+    for (size_t i = offset; i < offset + size; ++i) {
+        state = state * 1664525 + 1013904223;
+        payload[i] = uint8_t(state >> 24);
+    }
+}
+
+}  // namespace
+
+int main(int argc, char **argv) {
+    std::vector<Burst> bursts;
+
+    // A megabyte over a 64-bit bus: 2 KB bursts of 256 beats
+    Status st = splitBursts(0x10000, 1 << 20, 8, BurstType::INCR, bursts);
+    check(st.isOk(), "INCR split succeeds");
+    check(bursts.size() == 512, "a megabyte makes 512 bursts of 256 beats");
+    checkSplit(0x10000, 1 << 20, 8, bursts);
+
+    // A 128-bit bus reaches the 4 KB boundary before running out of beats
+    st = splitBursts(0x10000, 1 << 20, 16, BurstType::INCR, bursts);
+    check(st.isOk() && bursts.size() == 256 && bursts[0].length == 256, "4 KB bursts on a 128-bit bus");
+    checkSplit(0x10000, 1 << 20, 16, bursts);
+
+    // Unaligned start close to the boundary
+    st = splitBursts(0x1ffd, 100, 4, BurstType::INCR, bursts);
+    check(st.isOk() && bursts.size() == 2, "an unaligned transfer is split at the 4 KB boundary");
+    check(bursts[0].size == 3 && bursts[0].length == 1, "the first burst narrows to the boundary");
+    checkSplit(0x1ffd, 100, 4, bursts);
+
+    // FIXED bursts stay at the same address and have at most 16 beats
+    st = splitBursts(0x4000, 100, 4, BurstType::FIXED, bursts);
+    check(st.isOk() && bursts.size() == 2, "FIXED split succeeds");
+    check(bursts[0].address == 0x4000 && bursts[1].address == 0x4000, "FIXED bursts keep the address");
+    check(bursts[0].length == 16 && bursts[0].size == 64 && bursts[1].length == 9, "FIXED bursts have 16 beats");
+
+    // WRAP bursts cannot be split
+    st = splitBursts(0x1000, 64, 8, BurstType::WRAP, bursts);
+    check(st.isOk() && bursts.size() == 1 && bursts[0].length == 8, "a cache line is one WRAP burst");
+    st = splitBursts(0x1000, 48, 8, BurstType::WRAP, bursts);
+    check(st.isError(), "a WRAP burst of 6 beats is refused");
+    st = splitBursts(0x1004, 64, 8, BurstType::WRAP, bursts);
+    check(st.isError(), "an unaligned WRAP burst is refused");
+
+    st = splitBursts(0x1000, 64, 12, BurstType::INCR, bursts);
+    check(st.isError(), "a beat size that is not a power of two is refused");
+
+    check(encodeBeatSize(1) == 0 && encodeBeatSize(8) == 3 && encodeBeatSize(128) == 7, "AxSIZE encoding");
+
+    // The write strobes follow the data of the bursts, also when a burst starts in the middle of a strobe byte
+    const uint8_t strobe[] = {0xf0, 0x0f, 0xaa};
+    std::vector<uint8_t> slice;
+    sliceStrobe(strobe, 8, 12, slice);
+    check(slice.size() == 2 && slice[0] == 0x0f && slice[1] == 0x0a, "a strobe slice on a byte boundary");
+    sliceStrobe(strobe, 4, 8, slice);
+    check(slice.size() == 1 && slice[0] == 0xff, "a strobe slice across strobe bytes");
+    sliceStrobe(strobe, 13, 3, slice);
+    check(slice.size() == 1 && slice[0] == 0x00, "a strobe slice of cleared bits");
+
+    // Run-length encoding of the payloads
+    std::vector<uint8_t> zeros(4096, 0);
+    std::vector<uint8_t> encoded = checkRoundTrip(zeros, "an all-zero page");
+    check(encoded.size() < 8, "an all-zero page is a single record");
+
+    std::vector<uint8_t> repeated(4096);
+    const uint32_t word = 0xdeadbeef;
+    for (size_t i = 0; i < repeated.size(); i += sizeof(word)) {
+        memcpy(repeated.data() + i, &word, sizeof(word));
+    }
+    encoded = checkRoundTrip(repeated, "a page of a repeated word");
+    check(encoded.size() < 12, "a page of a repeated word is a single record");
+
+    std::vector<uint8_t> mixed(4096, 0);
+    fillNoise(mixed, 0, 100);
+    fillNoise(mixed, 1000, 333);
+    for (size_t i = 2000; i < 3000; i += sizeof(word)) {
+        memcpy(mixed.data() + i, &word, sizeof(word));
+    }
+    fillNoise(mixed, 3500, 17);
+    checkRoundTrip(mixed, "a page of literals, zeros and repeated words");
+
+    // Neither the runs nor the payload end on a word or a block boundary
+    std::vector<uint8_t> tail(1000 + 7, 0);
+    fillNoise(tail, 3, 10);
+    fillNoise(tail, tail.size() - 5, 5);
+    checkRoundTrip(tail, "a payload with an unaligned tail");
+    std::vector<uint8_t> shortTail(259, 0);
+    checkRoundTrip(shortTail, "a zero payload with an unaligned tail");
+
+    std::vector<uint8_t> noise(4096);
+    fillNoise(noise, 0, noise.size());
+    check(encodeRle(noise.data(), noise.size(), encoded) == 0, "an incompressible payload is not encoded");
+
+    // Malformed payloads are refused
+    encoded = checkRoundTrip(mixed, "the mixed page");
+    std::vector<uint8_t> decoded(mixed.size());
+    for (size_t cut = 1; cut < encoded.size(); cut += 37) {
+        check(decodeRle(encoded.data(), encoded.size() - cut, decoded.data(), decoded.size()) == -1,
+              "a truncated payload is refused");
+    }
+    check(decodeRle(encoded.data(), encoded.size(), decoded.data(), decoded.size() - 1) == -1,
+          "a payload decoding past the buffer is refused");
+    check(decodeRle(encoded.data(), encoded.size(), decoded.data(), decoded.size() + 1) == -1,
+          "a payload decoding short of the buffer is refused");
+
+    const uint8_t badTag[] = {0x07, 0x04, 0, 0, 0, 0};
+    check(decodeRle(badTag, sizeof(badTag), decoded.data(), 4) == -1, "an unknown record is refused");
+    const uint8_t badLength[] = {0x01, 0x80};
+    check(decodeRle(badLength, sizeof(badLength), decoded.data(), 0) == -1, "a truncated length is refused");
+    const uint8_t badLiteral[] = {0x00, 0x08, 1, 2, 3};
+    check(decodeRle(badLiteral, sizeof(badLiteral), decoded.data(), 8) == -1, "a truncated literal is refused");
+    const uint8_t badRepeat[] = {0x02, 0x02, 0xef, 0xbe};
+    check(decodeRle(badRepeat, sizeof(badRepeat), decoded.data(), 8) == -1, "a truncated word is refused");
+    const uint8_t hugeZeros[] = {0x01, 0xff, 0xff, 0xff, 0xff, 0x0f};
+    check(decodeRle(hugeZeros, sizeof(hugeZeros), decoded.data(), decoded.size()) == -1,
+          "a run past the buffer is refused");
+
+    if (failures) {
+        std::cerr << failures << " checks failed" << std::endl;
+        return 1;
+    }
+    std::cerr << "All checks passed" << std::endl;
+    return 0;
+}
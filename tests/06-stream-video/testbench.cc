@@ -0,0 +1,153 @@
+
+#include <SwAxi.hh>
+
+#include <chrono>
+#include <cstring>
+#include <future>
+#include <iostream>
+#include <thread>
+#include <vector>
+
+namespace {
+
+const uint64_t SINK_ADDR = 0x100000;
+const unsigned WIDTH = 1920;
+const unsigned HEIGHT = 1080;
+const unsigned LINE_SIZE = WIDTH * 3;
+const unsigned NUM_FRAMES = 30;
+
+uint8_t pixel(unsigned frame, unsigned line, unsigned byte) {
+    return frame * 7 + line * 3 + byte;
+}
+
+/**
+ * Checks the frames line by line: TUSER marks the start of a frame and TLAST the end of a line, as in AXI4-Stream
+ * video
+ */
+class VideoSink : public sw_axi::StreamSlave {
+public:
+    void onPacket(const sw_axi::StreamPacket *packet) override {
+        if (packet->size != LINE_SIZE || !packet->last || (packet->user == 1) != (line == 0)) {
+            ++errors;
+        } else {
+            for (unsigned i = 0; i < LINE_SIZE; i += 97) {
+                if (packet->data[i] != pixel(frame, line, i)) {
+                    ++errors;
+                    break;
+                }
+            }
+        }
+
+        if (++line == HEIGHT) {
+            line = 0;
+            if (++frame == NUM_FRAMES) {
+                done.set_value(errors);
+            }
+        }
+    }
+
+    std::promise<unsigned> done;
+
+private:
+    unsigned frame = 0;
+    unsigned line = 0;
+    unsigned errors = 0;
+};
+
+}  // namespace
+
+int main(int argc, char **argv) {
+    using namespace sw_axi;
+
+    Bridge bridge("06-stream-video");
+
+    Status st = bridge.connect();
+    if (st.isError()) {
+        std::cerr << "Unable to connect to the router: " << st.getMessage() << std::endl;
+        return 1;
+    }
+
+    VideoSink *sink = new VideoSink;
+    std::future<unsigned> sinkDone = sink->done.get_future();
+    IpConfig sinkConfig = {.name = "Video-Sink", .address = SINK_ADDR, .size = 1, .type = IpType::SLAVE_STREAM};
+    st = bridge.registerStreamSlave(sink, sinkConfig);
+    if (st.isError()) {
+        std::cerr << "Unable to register the video sink: " << st.getMessage() << std::endl;
+        return 1;
+    }
+
+    std::pair<StreamMaster *, Status> ret = bridge.registerStreamMaster("Video-Source");
+    if (ret.second.isError()) {
+        std::cerr << "Unable to register the video source: " << ret.second.getMessage() << std::endl;
+        return 1;
+    }
+    StreamMaster *source = ret.first;
+
+    st = bridge.commitIp();
+    if (st.isError()) {
+        std::cerr << "Unable to commit the IP: " << st.getMessage() << std::endl;
+        return 1;
+    }
+
+    st = bridge.start();
+    if (st.isError()) {
+        std::cerr << "Unable to start the bridge: " << st.getMessage() << std::endl;
+        return 1;
+    }
+
+    std::thread t([&]() {
+        // Each frame is rendered into a buffer of its own, since the lines are sent straight from it
+        std::vector<std::vector<uint8_t>> frames(2, std::vector<uint8_t>(LINE_SIZE * HEIGHT));
+        std::vector<std::future<Status>> pending;
+        auto start = std::chrono::steady_clock::now();
+
+        for (unsigned f = 0; f < NUM_FRAMES; ++f) {
+            for (auto &sent : pending) {
+                Status st = sent.get();
+                if (st.isError()) {
+                    std::cerr << "Send failed: " << st.getMessage() << std::endl;
+                }
+            }
+            pending.clear();
+
+            std::vector<uint8_t> &frame = frames[f % 2];
+            for (unsigned l = 0; l < HEIGHT; ++l) {
+                for (unsigned i = 0; i < LINE_SIZE; ++i) {
+                    frame[l * LINE_SIZE + i] = pixel(f, l, i);
+                }
+            }
+
+            for (unsigned l = 0; l < HEIGHT; ++l) {
+                StreamPacket packet = {.data = frame.data() + l * LINE_SIZE, .size = LINE_SIZE, .dest = SINK_ADDR};
+                packet.user = l == 0;
+                packet.last = true;
+                pending.push_back(source->send(&packet));
+            }
+        }
+
+        unsigned errors = sinkDone.get();
+        std::chrono::duration<double> elapsed = std::chrono::steady_clock::now() - start;
+        double bytes = double(NUM_FRAMES) * HEIGHT * LINE_SIZE;
+        std::cout << "Streamed " << NUM_FRAMES << " frames at " << NUM_FRAMES / elapsed.count() << " fps, "
+                  << bytes / elapsed.count() / 1e6 << " MB/s" << std::endl;
+        std::cout << (errors ? "NO MATCH!" : "MATCH!") << std::endl;
+
+        for (auto &sent : pending) {
+            sent.get();
+        }
+        source->terminate();
+    });
+
+    st = bridge.waitForCompletion();
+    if (st.isError()) {
+        std::cerr << "Failed to complete without errors: " << st.getMessage() << std::endl;
+        return 1;
+    }
+
+    t.join();
+
+    std::cerr << "Disconnecting" << std::endl;
+    bridge.disconnect();
+
+    return 0;
+}
@@ -0,0 +1,129 @@
+
+#include <SwAxi.hh>
+
+#include <algorithm>
+#include <atomic>
+#include <cerrno>
+#include <cstring>
+#include <iostream>
+#include <thread>
+
+namespace {
+
+const uint64_t DEVICE_ADDR = 0x1000;
+const uint32_t DEVICE_IRQ = 5;
+const unsigned NUM_JOBS = 1000;
+
+/**
+ * A device finishing a job as soon as its doorbell is rung and signaling it with an interrupt; the status register
+ * counts the finished jobs
+ */
+class Device : public sw_axi::Slave {
+public:
+    explicit Device(sw_axi::Bridge &bridge) : bridge(bridge) {}
+
+    int handleWrite(const sw_axi::Buffer *buffer) override {
+        ++finished;
+        return bridge.raiseInterrupt(DEVICE_IRQ).isOk() ? 0 : -1;
+    }
+
+    int handleRead(sw_axi::Buffer *buffer) override {
+        uint32_t value = finished;
+        memcpy(buffer->data, &value, std::min<uint64_t>(buffer->size, sizeof(value)));
+        return 0;
+    }
+
+private:
+    sw_axi::Bridge &bridge;
+    std::atomic<uint32_t> finished{0};
+};
+
+}  // namespace
+
+int main(int argc, char **argv) {
+    using namespace sw_axi;
+
+    Bridge bridge("07-interrupts");
+
+    Status st = bridge.connect();
+    if (st.isError()) {
+        std::cerr << "Unable to connect to the router: " << st.getMessage() << std::endl;
+        return 1;
+    }
+
+    IpConfig deviceConfig = {
+            .name = "Soft-Device",
+            .address = DEVICE_ADDR,
+            .size = 8,
+            .firstInterrupt = DEVICE_IRQ,
+            .numInterrupts = 1,
+            .type = IpType::SLAVE_LITE};
+    st = bridge.registerSlave(new Device(bridge), deviceConfig);
+    if (st.isError()) {
+        std::cerr << "Unable to register the device: " << st.getMessage() << std::endl;
+        return 1;
+    }
+
+    std::pair<Master *, Status> ret = bridge.registerMaster("Driver");
+    if (ret.second.isError()) {
+        std::cerr << "Unable to register the driver: " << ret.second.getMessage() << std::endl;
+        return 1;
+    }
+    Master *master = ret.first;
+
+    std::atomic<uint32_t> callbackRaises{0};
+    bridge.onInterrupt(DEVICE_IRQ, [&](uint32_t number, uint32_t raises) { callbackRaises += raises; });
+
+    st = bridge.commitIp();
+    if (st.isError()) {
+        std::cerr << "Unable to commit the IP: " << st.getMessage() << std::endl;
+        return 1;
+    }
+
+    st = bridge.start();
+    if (st.isError()) {
+        std::cerr << "Unable to start the bridge: " << st.getMessage() << std::endl;
+        return 1;
+    }
+
+    std::thread t([&]() {
+        // The driver sleeps on the interrupt instead of polling the status register
+        unsigned errors = 0;
+        for (unsigned i = 0; i < NUM_JOBS; ++i) {
+            uint32_t value = 1;
+            Buffer doorbell = {.data = reinterpret_cast<uint8_t *>(&value), .size = 4, .address = DEVICE_ADDR};
+            Status st = master->write(&doorbell).get();
+            std::pair<uint32_t, Status> irq = bridge.waitInterrupt(DEVICE_IRQ, 1000000);
+            if (st.isError() || irq.second.isError()) {
+                ++errors;
+                continue;
+            }
+
+            Buffer status = {.data = reinterpret_cast<uint8_t *>(&value), .size = 4, .address = DEVICE_ADDR + 4};
+            st = master->read(&status).get();
+            if (st.isError() || value != i + 1) {
+                ++errors;
+            }
+        }
+
+        std::pair<uint32_t, Status> spurious = bridge.waitInterrupt(DEVICE_IRQ, 1000);
+        if (spurious.second.getCode() != ETIMEDOUT || callbackRaises != NUM_JOBS) {
+            ++errors;
+        }
+        std::cout << (errors ? "NO MATCH!" : "MATCH!") << std::endl;
+        master->terminate();
+    });
+
+    st = bridge.waitForCompletion();
+    if (st.isError()) {
+        std::cerr << "Failed to complete without errors: " << st.getMessage() << std::endl;
+        return 1;
+    }
+
+    t.join();
+
+    std::cerr << "Disconnecting" << std::endl;
+    bridge.disconnect();
+
+    return 0;
+}
@@ -0,0 +1,243 @@
+
+#include <SwAxi.hh>
+
+#include <atomic>
+#include <chrono>
+#include <cstring>
+#include <iostream>
+#include <thread>
+#include <vector>
+
+namespace {
+
+const uint64_t RAM_ADDR = 0x1000;
+const uint64_t RAM_SIZE = 0x1000;
+const uint64_t SLOW_ADDR = RAM_ADDR + 0x800;  //!< Reads from here take a while
+const unsigned NUM_MIXED = 256;  //!< Words written and read concurrently
+const uint64_t BULK_ADDR = 0x100000;
+const uint64_t BULK_SIZE = 0x500000;  //!< Larger than a quarter of the default shared memory ring of 16 MB
+const unsigned NUM_BULK = 3;  //!< Bulk transfers; enough to go around the shared memory rings
+
+/**
+ * A RAM honoring the write strobes and completing the requests with different AXI IDs out of order
+ */
+class Ram : public sw_axi::Slave {
+public:
+    Ram(uint64_t address, uint64_t size) : address(address), data(size, 0xee) {}
+
+    int handleWrite(const sw_axi::Buffer *buffer) override {
+        uint8_t *dest = data.data() + (buffer->address - address);
+        for (uint64_t i = 0; i < buffer->size; ++i) {
+            if (!buffer->strobe || (buffer->strobe[i / 8] & (1 << i % 8))) {
+                dest[i] = buffer->data[i];
+            }
+        }
+        return 0;
+    }
+
+    int handleRead(sw_axi::Buffer *buffer) override {
+        if (buffer->address == SLOW_ADDR) {
+            std::this_thread::sleep_for(std::chrono::milliseconds(200));
+        }
+        memcpy(buffer->data, data.data() + (buffer->address - address), buffer->size);
+        return 0;
+    }
+
+    bool completesOutOfOrder() const override {
+        return true;
+    }
+
+private:
+    uint64_t address;
+    std::vector<uint8_t> data;
+};
+
+}  // namespace
+
+int main(int argc, char **argv) {
+    using namespace sw_axi;
+
+    BridgeConfig config;
+    config.numSlaveWorkers = 2;
+#ifdef SPLIT_CHANNELS
+    // The reads and the writes get their IDs on writers of their own and retire them on readers of their own
+    config.splitChannels = true;
+#endif
+    Bridge bridge("08-axi-id-strobe", config);
+
+#ifdef SHM_TRANSPORT
+    // Everything goes through the shared memory rings; the socket is only used for the rendez-vous
+    Status st = bridge.connect("shm:///tmp/sw-axi");
+#else
+    Status st = bridge.connect();
+#endif
+    if (st.isError()) {
+        std::cerr << "Unable to connect to the router: " << st.getMessage() << std::endl;
+        return 1;
+    }
+
+    IpConfig ramConfig = {.name = "Soft-RAM", .address = RAM_ADDR, .size = RAM_SIZE, .type = IpType::SLAVE};
+    st = bridge.registerSlave(new Ram(RAM_ADDR, RAM_SIZE), ramConfig);
+    if (st.isError()) {
+        std::cerr << "Unable to register the Soft-RAM slave: " << st.getMessage() << std::endl;
+        return 1;
+    }
+
+    IpConfig bulkConfig = {.name = "Bulk-RAM", .address = BULK_ADDR, .size = BULK_SIZE, .type = IpType::SLAVE};
+    st = bridge.registerSlave(new Ram(BULK_ADDR, BULK_SIZE), bulkConfig);
+    if (st.isError()) {
+        std::cerr << "Unable to register the Bulk-RAM slave: " << st.getMessage() << std::endl;
+        return 1;
+    }
+
+    std::pair<Master *, Status> ret = bridge.registerMaster("Soft-Master");
+    if (ret.second.isError()) {
+        std::cerr << "Unable to register a master: " << ret.second.getMessage() << std::endl;
+        return 1;
+    }
+    Master *master = ret.first;
+
+    st = bridge.commitIp();
+    if (st.isError()) {
+        std::cerr << "Unable to commit the IP: " << st.getMessage() << std::endl;
+        return 1;
+    }
+
+    st = bridge.start();
+    if (st.isError()) {
+        std::cerr << "Unable to start the bridge: " << st.getMessage() << std::endl;
+        return 1;
+    }
+
+    std::thread t([&]() {
+        unsigned errors = 0;
+
+        // One strobed write sets every other byte of a word and leaves the rest alone
+        std::vector<uint8_t> pattern(64, 0x5a);
+        std::vector<uint8_t> strobe(8, 0x55);
+        Buffer wb = {.data = pattern.data(), .size = pattern.size(), .address = RAM_ADDR};
+        wb.strobe = strobe.data();
+        if (master->write(&wb).get().isError()) {
+            ++errors;
+        }
+
+        std::vector<uint8_t> readBack(64);
+        Buffer rb = {.data = readBack.data(), .size = readBack.size(), .address = RAM_ADDR};
+        if (master->read(&rb).get().isError()) {
+            ++errors;
+        }
+        for (size_t i = 0; i < readBack.size(); ++i) {
+            if (readBack[i] != (i % 2 ? 0xee : 0x5a)) {
+                ++errors;
+                break;
+            }
+        }
+
+        // A fast read with another ID overtakes the slow one issued before it
+        uint8_t slow[4], fast[4];
+        Buffer slowBuffer = {.data = slow, .size = 4, .address = SLOW_ADDR};
+        slowBuffer.axiId = 1;
+        Buffer fastBuffer = {.data = fast, .size = 4, .address = RAM_ADDR};
+        fastBuffer.axiId = 2;
+        std::future<Status> slowDone = master->read(&slowBuffer);
+        std::future<Status> fastDone = master->read(&fastBuffer);
+        if (fastDone.get().isError() || slowDone.wait_for(std::chrono::seconds(0)) == std::future_status::ready) {
+            ++errors;
+        }
+        if (slowDone.get().isError()) {
+            ++errors;
+        }
+
+        // Writes from one thread and reads from another are in flight together
+        std::atomic<unsigned> writeErrors{0};
+        std::thread writer([&]() {
+            std::vector<std::future<Status>> done;
+            for (unsigned i = 0; i < NUM_MIXED; ++i) {
+                uint8_t word[4] = {uint8_t(i), uint8_t(i), uint8_t(i), uint8_t(i)};
+                Buffer b = {.data = word, .size = 4, .address = RAM_ADDR + 4 * i};
+                done.push_back(master->write(&b));
+            }
+            for (auto &d : done) {
+                if (d.get().isError()) {
+                    ++writeErrors;
+                }
+            }
+        });
+
+        std::vector<uint8_t> words(4 * NUM_MIXED);
+        std::vector<Buffer> readBuffers(NUM_MIXED);
+        std::vector<std::future<Status>> readsDone;
+        for (unsigned i = 0; i < NUM_MIXED; ++i) {
+            readBuffers[i] = {.data = &words[4 * i], .size = 4, .address = RAM_ADDR + 0x400 + 4 * i};
+            readsDone.push_back(master->read(&readBuffers[i]));
+        }
+        for (auto &d : readsDone) {
+            if (d.get().isError()) {
+                ++errors;
+            }
+        }
+        writer.join();
+        errors += writeErrors;
+
+        Buffer wordsBuffer = {.data = words.data(), .size = words.size(), .address = RAM_ADDR};
+        if (master->read(&wordsBuffer).get().isError()) {
+            ++errors;
+        }
+        for (size_t i = 0; i < words.size(); ++i) {
+            if (words[i] != uint8_t(i / 4)) {
+                ++errors;
+                break;
+            }
+        }
+
+        // Transfers larger than a quarter of a shared memory ring span multiple records, and the repeated ones wrap
+        // around the end of the rings; the payload is noise, so the run-length encoding does not shrink it
+        std::vector<uint8_t> bulk(BULK_SIZE), bulkBack(BULK_SIZE);
+        for (unsigned round = 0; round < NUM_BULK; ++round) {
+            uint32_t state = round + 1;
+            for (uint8_t &byte : bulk) {
+                state = state * 1664525 + 1013904223;
+                byte = uint8_t(state >> 24);
+            }
+            Buffer bulkWrite = {.data = bulk.data(), .size = bulk.size(), .address = BULK_ADDR};
+            Buffer bulkRead = {.data = bulkBack.data(), .size = bulkBack.size(), .address = BULK_ADDR};
+            if (master->write(&bulkWrite).get().isError() || master->read(&bulkRead).get().isError() ||
+                bulk != bulkBack) {
+                ++errors;
+                break;
+            }
+        }
+
+#ifndef SPLIT_CHANNELS
+        // Without split channels, a read issued right behind a write of the same address sees the written data
+        for (unsigned i = 0; i < NUM_MIXED; ++i) {
+            uint8_t written[4] = {uint8_t(~i), uint8_t(i), uint8_t(~i), uint8_t(i)};
+            uint8_t read[4] = {};
+            Buffer wordWrite = {.data = written, .size = 4, .address = RAM_ADDR + 0x100};
+            Buffer wordRead = {.data = read, .size = 4, .address = RAM_ADDR + 0x100};
+            std::future<Status> writeDone = master->write(&wordWrite);
+            std::future<Status> readDone = master->read(&wordRead);
+            if (writeDone.get().isError() || readDone.get().isError() || memcmp(written, read, 4)) {
+                ++errors;
+                break;
+            }
+        }
+#endif
+
+        std::cout << (errors ? "NO MATCH!" : "MATCH!") << std::endl;
+        master->terminate();
+    });
+
+    st = bridge.waitForCompletion();
+    if (st.isError()) {
+        std::cerr << "Failed to complete without errors: " << st.getMessage() << std::endl;
+        return 1;
+    }
+
+    t.join();
+
+    std::cerr << "Disconnecting" << std::endl;
+    bridge.disconnect();
+
+    return 0;
+}
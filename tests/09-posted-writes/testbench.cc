@@ -0,0 +1,132 @@
+
+#include <SwAxi.hh>
+
+#include <chrono>
+#include <cstring>
+#include <iostream>
+#include <thread>
+#include <vector>
+
+namespace {
+
+const uint64_t REGS_ADDR = 0x10000;
+const unsigned NUM_REGS = 4096;
+const uint64_t READ_ONLY_ADDR = REGS_ADDR + 4 * 100;  //!< Writes to this register fail
+
+/**
+ * A bank of 32-bit configuration registers
+ */
+class Registers : public sw_axi::Slave {
+public:
+    Registers() : regs(NUM_REGS, 0) {}
+
+    int handleWrite(const sw_axi::Buffer *buffer) override {
+        if (buffer->address == READ_ONLY_ADDR) {
+            return -1;
+        }
+        memcpy(&regs[(buffer->address - REGS_ADDR) / 4], buffer->data, buffer->size);
+        return 0;
+    }
+
+    int handleRead(sw_axi::Buffer *buffer) override {
+        memcpy(buffer->data, &regs[(buffer->address - REGS_ADDR) / 4], buffer->size);
+        return 0;
+    }
+
+private:
+    std::vector<uint32_t> regs;
+};
+
+}  // namespace
+
+int main(int argc, char **argv) {
+    using namespace sw_axi;
+
+    Bridge bridge("09-posted-writes");
+
+    Status st = bridge.connect();
+    if (st.isError()) {
+        std::cerr << "Unable to connect to the router: " << st.getMessage() << std::endl;
+        return 1;
+    }
+
+    IpConfig regsConfig = {.name = "Config-Space", .address = REGS_ADDR, .size = 4 * NUM_REGS, .type = IpType::SLAVE};
+    st = bridge.registerSlave(new Registers, regsConfig);
+    if (st.isError()) {
+        std::cerr << "Unable to register the registers: " << st.getMessage() << std::endl;
+        return 1;
+    }
+
+    MasterConfig masterConfig;
+    masterConfig.postedWrites = true;
+    std::pair<Master *, Status> ret = bridge.registerMaster("Soft-Master", masterConfig);
+    if (ret.second.isError()) {
+        std::cerr << "Unable to register a master: " << ret.second.getMessage() << std::endl;
+        return 1;
+    }
+    Master *master = ret.first;
+
+    st = bridge.commitIp();
+    if (st.isError()) {
+        std::cerr << "Unable to commit the IP: " << st.getMessage() << std::endl;
+        return 1;
+    }
+
+    st = bridge.start();
+    if (st.isError()) {
+        std::cerr << "Unable to start the bridge: " << st.getMessage() << std::endl;
+        return 1;
+    }
+
+    std::thread t([&]() {
+        unsigned errors = 0;
+
+        // Program the whole configuration space, the read-only register included, and only then check the outcome
+        auto start = std::chrono::steady_clock::now();
+        for (unsigned i = 0; i < NUM_REGS; ++i) {
+            uint32_t value = i * 3 + 1;
+            Buffer b = {.data = reinterpret_cast<uint8_t *>(&value), .size = 4, .address = REGS_ADDR + 4 * i};
+            master->write(&b);
+        }
+        Status fenced = master->fence();
+        std::chrono::duration<double> elapsed = std::chrono::steady_clock::now() - start;
+        std::cout << "Programmed " << NUM_REGS << " registers in " << elapsed.count() * 1e3 << " ms" << std::endl;
+        if (fenced.isOk()) {
+            ++errors;
+        }
+
+        // The failure has been reported, so the next fence is clean
+        uint32_t value = 0;
+        Buffer extra = {.data = reinterpret_cast<uint8_t *>(&value), .size = 4, .address = REGS_ADDR};
+        master->writePosted(&extra);
+        if (master->fence().isError()) {
+            ++errors;
+        }
+
+        for (unsigned i = 1; i < NUM_REGS; ++i) {
+            Buffer b = {.data = reinterpret_cast<uint8_t *>(&value), .size = 4, .address = REGS_ADDR + 4 * i};
+            Status st = master->read(&b).get();
+            uint32_t expected = REGS_ADDR + 4 * i == READ_ONLY_ADDR ? 0 : i * 3 + 1;
+            if (st.isError() || value != expected) {
+                ++errors;
+                break;
+            }
+        }
+
+        std::cout << (errors ? "NO MATCH!" : "MATCH!") << std::endl;
+        master->terminate();
+    });
+
+    st = bridge.waitForCompletion();
+    if (st.isError()) {
+        std::cerr << "Failed to complete without errors: " << st.getMessage() << std::endl;
+        return 1;
+    }
+
+    t.join();
+
+    std::cerr << "Disconnecting" << std::endl;
+    bridge.disconnect();
+
+    return 0;
+}